@@ -23,10 +23,58 @@ typedef struct arp_pkt
 
 #pragma pack()
 
+typedef enum arp_state //邻居缓存表项的状态
+{
+    ARP_REACHABLE, // 最近确认过可达
+    ARP_STALE,     // 可达时间已过，仍可使用，被使用时转入DELAY
+    ARP_DELAY,     // 已被使用，等待上层确认，超时后转入PROBE
+    ARP_PROBE,     // 正在向缓存的mac地址单播arp请求
+    ARP_FAILED,    // 探测无响应，发送时重新广播解析
+} arp_state_t;
+
+typedef struct arp_entry //邻居缓存表项
+{
+    uint8_t mac[NET_MAC_LEN]; // mac地址，须为第一个字段
+    uint8_t state;            // 状态，arp_state_t
+    uint8_t probes;           // PROBE状态下已发送的单播请求数
+    uint8_t if_index;         // 邻居所在的网卡序号
+    uint64_t confirmed_ms;    // 最近一次确认可达的时间
+    uint64_t refreshed_ms;    // 最近一次刷新表项超时时间的时间
+    uint64_t deadline_ms;     // DELAY/PROBE状态下一次动作的时间
+} arp_entry_t;
+
+typedef struct arp_cache //缓存在连接或发送上下文中的下一跳mac地址，省去每个包的查表
+{
+    uint8_t mac[NET_MAC_LEN]; // 下一跳mac地址
+    uint32_t gen;             // 取得时的arp_generation，不相等或为0时无效
+    uint64_t expire_ms;       // 表项可能不再处于REACHABLE的时间，此后需要重新查表推进状态
+} arp_cache_t;
+
+typedef struct arp_pending //等待arp解析的数据包队列
+{
+    uint8_t count;                     // 队列中的数据包数
+    size_t bytes;                      // 队列中数据包的总长度
+    buf_t bufs[ARP_PENDING_MAX_PKTS];  // 按到达顺序排列的数据包，尽量与原数据包共享数据块
+} arp_pending_t;
+
+typedef struct arp_stats //arp等待队列的统计计数
+{
+    uint64_t queued;       // 进入等待队列的数据包数
+    uint64_t flushed;      // 解析完成后从队列发出的数据包数
+    uint64_t drop_full;    // 队列包数或字节数已达上限而丢弃的数据包数
+    uint64_t drop_timeout; // 等待解析超时而丢弃的数据包数
+    uint64_t drop_nomem;   // 内存不足而丢弃的数据包数
+} arp_stats_t;
+
+extern arp_stats_t arp_stats;
+extern uint32_t arp_generation;
+
 void arp_init();
 void arp_print();
 void arp_in(buf_t *buf, uint8_t *src_mac);
 void arp_out(buf_t *buf, uint8_t *ip);
-void arp_req(uint8_t *target_ip);
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac);
+void arp_out_cached(buf_t *buf, uint8_t *ip, arp_cache_t *cache);
+void arp_confirm(uint8_t *ip);
+void arp_req(net_if_t *netif, uint8_t *target_ip);
+void arp_resp(net_if_t *netif, uint8_t *target_ip, uint8_t *target_mac);
 #endif
\ No newline at end of file
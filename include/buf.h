@@ -5,18 +5,50 @@
 #include <stdint.h>
 #include "config.h"
 
+typedef struct buf_mem //buffer池中的数据块，按cache line对齐，多个buf_t可以共享同一数据块
+{
+    struct buf_mem *next;                    // 空闲链表中的下一个数据块
+    uint32_t ref;                            // 引用计数
+    uint32_t size;                           // 数据区容量
+    _Alignas(BUF_ALIGN) uint8_t payload[];   // 数据区
+} buf_mem_t;
+
+#define BUF_CSUM_IP_VALID 0x01 // 驱动已确认IP头部校验和正确
+#define BUF_CSUM_L4_VALID 0x02 // 驱动已确认TCP/UDP校验和正确
+#define BUF_CSUM_PARTIAL 0x04  // 校验和留待发送时补全：从csum_start起求反码和，取反后写到csum_start+csum_offset，该处预先填入伪头部的反码和
+
 typedef struct buf //协议栈的通用数据包buffer, 可以在头部装卸数据，以供协议头的添加和去除
 {
     size_t len;                   // 包中有效数据大小
     uint8_t *data;                // 包的数据起始地址
-    uint8_t payload[BUF_MAX_LEN]; // 最大负载数据量
+    uint8_t *payload;             // 数据区起始地址
+    size_t size;                  // 数据区容量
+    buf_mem_t *mem;               // 引用的数据块，NULL表示尚未分配或引用外部数据
+    struct buf *next;             // 分散/聚集链中的下一段，段由调用者持有，NULL表示最后一段
+    uint8_t csum_flags;           // 校验和卸载标志BUF_CSUM_*，由驱动和上层协议设置
+    uint8_t if_index;             // 收到该包的网卡序号，发送时为出口网卡序号，由驱动和ip层设置
+    uint8_t l2_bcast;             // 收到时目的mac不是网卡的mac，即链路层广播或组播，由以太网层设置，这样的包不转发
+    uint16_t csum_start;          // BUF_CSUM_PARTIAL时校验范围相对data的起点，装卸头部时随之调整
+    uint16_t csum_offset;         // BUF_CSUM_PARTIAL时校验和字段相对csum_start的偏移
 } buf_t;
 
 int buf_init(buf_t *buf, size_t len);
+int buf_alloc(buf_t *buf, size_t size);
+void buf_free(buf_t *buf);
+void buf_init_ref(buf_t *buf, uint8_t *data, size_t len);
+size_t buf_chain_len(const buf_t *buf);
+size_t buf_gather(const buf_t *buf, uint8_t *dst, size_t max);
+size_t buf_gather_csum(const buf_t *buf, uint8_t *dst, size_t max);
+void buf_csum_partial(buf_t *buf, size_t start, size_t offset, uint16_t sum);
+int buf_csum_resolve(buf_t *buf);
+int buf_slice(buf_t *segs, size_t max, const buf_t *src, size_t offset, size_t len);
+int buf_linearize(buf_t *buf);
+uint16_t buf_checksum16(const buf_t *buf);
 int buf_add_header(buf_t *buf, size_t len);
 int buf_remove_header(buf_t *buf, size_t len);
 int buf_add_padding(buf_t *buf, size_t len);
 int buf_remove_padding(buf_t *buf, size_t len);
 void buf_copy(void *pdst, const void *psrc, size_t len);
+void buf_clone(void *pdst, const void *psrc, size_t len);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,18 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint16_t (*checksum_fn_t)(const void *data, size_t len);                  //计算一段数据的16位反码和(未取反)
+typedef uint16_t (*checksum_copy_fn_t)(void *dst, const void *src, size_t len); //拷贝一段数据并计算其反码和
+
+uint16_t checksum_sum16(const void *data, size_t len);
+uint16_t checksum_copy16(void *dst, const void *src, size_t len);
+uint16_t checksum_combine(uint16_t sum, uint16_t part, size_t offset);
+uint16_t checksum_adjust16(uint16_t check, uint16_t old_word, uint16_t new_word);
+uint16_t checksum_adjust32(uint16_t check, uint32_t old_word, uint32_t new_word);
+int checksum_select(const char *name);
+const char *checksum_selected();
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+typedef uint64_t (*clock_source_t)(void); //时钟源，返回毫秒时间戳
+
+extern uint64_t clock_ms; //缓存的协议栈时钟，每次轮询刷新一次
+
+void clock_init();
+void clock_update();
+void clock_set_source(clock_source_t source);
+void clock_set_virtual(uint64_t now_ms);
+void clock_advance(uint64_t delta_ms);
+
+//获取缓存的毫秒时间戳
+static inline uint64_t clock_now_ms() {
+    return clock_ms;
+}
+//获取缓存的秒级时间戳，用于替代time(NULL)
+static inline time_t clock_now() {
+    return (time_t)(clock_ms / 1000);
+}
+
+#endif
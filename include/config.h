@@ -9,6 +9,7 @@
 #define TCP
 #define HTTP
 
+// #define NET_STATIC_DISPATCH //协议集固定时在编译期直接分派，不查协议表；测试时用假协议替换模块，不可开启
 
 #ifdef TEST
 #define NET_IF_IP    \
@@ -29,17 +30,59 @@
         0x00, 0x11, 0x22, 0x33, 0x44, 0x55 \
     } //自定义网卡mac地址
 #endif 
+#define NET_IF_PREFIX_LEN 24 //默认网卡所在子网的前缀长度，作为直连路由
+#define NET_IF_MAX 4         //网卡个数上限，默认网卡之外的网卡在net_init前用net_if_add添加
+// #define NET_IF_GATEWAY {192, 168, 56, 1} //默认网关，未定义时所有目的地址都视为直连
 
 
 
 #define ETHERNET_MAX_TRANSPORT_UNIT 1500 //以太网最大传输单元
 
+// #define DRIVER_TPACKET //Linux下使用AF_PACKET的TPACKET_V3内存映射环形缓冲区代替pcap收发包
+#define DRIVER_TPACKET_BLOCK_SIZE (1 << 20) //TPACKET环形缓冲区每块大小
+#define DRIVER_TPACKET_BLOCK_NR 32          //TPACKET环形缓冲区块数
+#define DRIVER_TPACKET_FRAME_SIZE 2048      //TPACKET环形缓冲区帧大小
+#define DRIVER_TPACKET_TIMEOUT_MS 10        //块未写满时内核交还该块的超时(毫秒)
+#define DRIVER_TX_QUEUE_LEN 64              //发送队列长度，队列满或每次轮询结束时一次性交给内核
+
+#define NET_BURST_SIZE 32 //一次轮询最多批量接收并逐层批处理的数据包数
+#define NET_L2_PROTOCOL_MAX 4 //可注册的二层协议(ethertype)个数上限
+
 #define ARP_TIMEOUT_SEC (60 * 5) //arp表过期时间
 #define ARP_MIN_INTERVAL 1       //向相同地址发送arp请求的最小间隔
+#define ARP_REACHABLE_MS 30000     //邻居确认可达后保持REACHABLE的时间(毫秒)
+#define ARP_DELAY_MS 5000          //STALE表项被使用后等待上层确认的时间(毫秒)，超时后开始单播探测
+#define ARP_PROBE_INTERVAL_MS 1000 //单播探测的重传间隔(毫秒)
+#define ARP_PROBE_MAX 3            //单播探测的最大次数，全部无响应时表项失效
+#define ARP_PENDING_MAX_PKTS 64          //每个待解析地址最多缓存的数据包数，能容纳一个最大的数据报按以太网MTU分成的45个分片
+#define ARP_PENDING_MAX_BYTES (72 * 1024) //每个待解析地址缓存的数据包总长度上限，同上
 
 #define IP_DEFALUT_TTL 64 //IP默认TTL
+#define IP_FORWARD 0      //为1时转发目的地址不是本机的数据包，作为路由器运行；运行时可改ip_forwarding
+#define IP_REASS_TIMEOUT_SEC 30            //分片重组超时(秒)，从收到第一个分片起计时
+#define IP_REASS_MAX_FRAGS 64              //一个数据报最多的分片数
+#define IP_REASS_MAX_BYTES (1024 * 1024)   //重组中的分片占用的数据块总大小上限，超出时淘汰最早的数据报
+#define IP_PMTU_TIMEOUT_SEC (60 * 10)      //路径MTU缓存的老化时间，过期后恢复为出口网卡的MTU重新探测
+#define IP_PMTU_MAX_ENTRIES 1024           //路径MTU缓存的条目上限
+#define IP_PMTU_MIN 552                    //接受的最小路径MTU，更小的通告按此值记录，此时发出的包不再设置DF
+
+#define ICMP_ERROR_RATE 1000 //每秒最多发出的icmp差错报文数，令牌桶按此速率补充
+#define ICMP_ERROR_BURST 50  //icmp差错报文令牌桶的容量，即允许连续发出的个数
+
+#define ROUTE_TBL8_GROW 64 //路由表二级表不足时一次扩充的组数，每组对应一个含有长于/24前缀的/24
 
 #define BUF_MAX_LEN (2 * UINT16_MAX + UINT8_MAX) //buf最大长度
+#define BUF_ALIGN 64          //buffer数据块对齐字节数，取cache line大小
+#define BUF_BLOCK_LEN 2048    //buffer池中数据块的大小，可容纳一个完整的以太网帧
+#define BUF_HEADROOM 128      //buf_init在数据前预留的协议头空间
+#define BUF_POOL_GROW 64      //buffer池不足时一次扩充的数据块数
+
+#define MAP_MIN_BUCKETS 8 //map哈希索引的最小槽数，容量随负载倍增或减半
+
+#define TIMER_TICK_MS 10      //时间轮刻度(毫秒)
+#define TIMER_WHEEL_BITS 6    //时间轮每层槽数的位数
+#define TIMER_WHEEL_LEVELS 4  //时间轮层数
 
-#define MAP_MAX_LEN (16 * BUF_MAX_LEN) //map最大长度
+#define LOOP_BUSY_POLL_US 200 //无流量持续该时间(微秒)后由忙轮询转入阻塞等待，为0时空闲即阻塞
+#define LOOP_IDLE_SLEEP_MS 1  //驱动不能提供可等待的描述符时，空闲时每次休眠的最长时间(毫秒)
 #endif
\ No newline at end of file
@@ -6,8 +6,12 @@
 #ifndef PCAP_BUF_SIZE
 #define PCAP_BUF_SIZE 1024
 #endif
-int driver_open();
-int driver_recv(buf_t *buf);
+int driver_open(net_if_t *netif);
+int driver_recv(net_if_t *netif, buf_t *buf);
+int driver_recv_burst(net_if_t *netif, buf_t **bufs, int max);
 int driver_send(buf_t *buf);
+int driver_tx_room(net_if_t *netif);
+int driver_flush();
+int driver_fd(net_if_t *netif);
 void driver_close();
 #endif
\ No newline at end of file
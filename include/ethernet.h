@@ -16,7 +16,8 @@ typedef struct ether_hdr
 #pragma pack()
 void ethernet_init();
 void ethernet_in(buf_t *buf);
+void ethernet_in_burst(buf_t **bufs, int n);
 void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
-void ethernet_poll();
+int ethernet_poll();
 static const uint8_t ether_broadcast_mac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}; //以太网广播mac地址
 #endif
\ No newline at end of file
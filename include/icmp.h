@@ -19,14 +19,22 @@ typedef enum icmp_type
     ICMP_TYPE_ECHO_REQUEST = 8, // 回显请求
     ICMP_TYPE_ECHO_REPLY = 0,   // 回显响应
     ICMP_TYPE_UNREACH = 3,      // 目的不可达
+    ICMP_TYPE_SOURCE_QUENCH = 4, // 源抑制
+    ICMP_TYPE_REDIRECT = 5,     // 重定向
+    ICMP_TYPE_TIME_EXCEEDED = 11, // 超时
+    ICMP_TYPE_PARAM_PROBLEM = 12, // 参数问题
 } icmp_type_t;
 
 typedef enum icmp_code
 {
+    ICMP_CODE_NET_UNREACH = 0,      // 网络不可达
     ICMP_CODE_PROTOCOL_UNREACH = 2, // 协议不可达
-    ICMP_CODE_PORT_UNREACH = 3      // 端口不可达
+    ICMP_CODE_PORT_UNREACH = 3,     // 端口不可达
+    ICMP_CODE_FRAG_NEEDED = 4       // 需要分片但设置了DF
 } icmp_code_t;
 void icmp_in(buf_t *buf, uint8_t *src_ip);
 void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code);
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip);
+void icmp_frag_needed(buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu);
 void icmp_init();
 #endif
@@ -2,6 +2,7 @@
 #define IP_H
 
 #include "net.h"
+#include "arp.h"
 
 #pragma pack(1)
 typedef struct ip_hdr
@@ -24,7 +25,50 @@ typedef struct ip_hdr
 #define IP_HDR_OFFSET_PER_BYTE 8   //ip分片偏移长度单位
 #define IP_VERSION_4 4             //ipv4
 #define IP_MORE_FRAGMENT (1 << 13) //ip分片mf位
+#define IP_DONT_FRAGMENT (1 << 14) //ip分片df位
+#define IP_FRAG_MAX_SEGS 8         //一个分片负载最多引用的buffer段数
+#define IP_FRAG_OFFSET_MASK 0x1fff //ip分片偏移字段掩码
+
+typedef struct ip_reass_key //分片重组的键
+{
+    uint8_t src_ip[NET_IP_LEN]; // 源IP
+    uint8_t dst_ip[NET_IP_LEN]; // 目标IP
+    uint8_t protocol;           // 上层协议
+    uint8_t pad;                // 填充，置0
+    uint16_t id16;              // 标识符
+} ip_reass_key_t;
+
+typedef struct ip_reass //正在重组的数据报，分片按偏移排列且互不重叠
+{
+    uint16_t count;                       // 已收到的分片数
+    uint8_t last;                         // 是否已收到最后一个分片
+    uint32_t total;                       // 负载总长度，收到最后一个分片后有效
+    uint32_t received;                    // 已收到的负载字节数
+    size_t mem;                           // 分片占用的数据块大小之和
+    uint16_t offsets[IP_REASS_MAX_FRAGS]; // 各分片负载在数据报中的偏移
+    buf_t frags[IP_REASS_MAX_FRAGS];      // 各分片负载，尽量与收到的帧共享数据块，头部空间中保留ip头
+} ip_reass_t;
+
+typedef struct ip_stats //转发路径的统计计数
+{
+    uint64_t forwarded;    // 转发出去的数据包数
+    uint64_t ttl_exceeded; // TTL耗尽而丢弃的数据包数
+    uint64_t no_route;     // 没有路由而丢弃的数据包数
+    uint64_t too_big;      // 设置了DF且超过出口网卡MTU而丢弃的数据包数，回复icmp需要分片
+    uint64_t fragmented;   // 超过出口网卡MTU而分片转发的数据包数
+    uint64_t pmtu_updates; // 因icmp需要分片而降低路径MTU的次数
+} ip_stats_t;
+
+extern ip_stats_t ip_stats;
+extern int ip_forwarding;
+
 void ip_in(buf_t *buf, uint8_t *src_mac);
+void ip_in_burst(buf_t **bufs, uint8_t **src_macs, int n);
 void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+void ip_out_cached(buf_t *buf, uint8_t *ip, net_protocol_t protocol, arp_cache_t *nh);
+uint8_t *ip_source(const uint8_t *ip);
+uint16_t ip_path_mtu(const uint8_t *ip);
+int ip_directed_bcast(const uint8_t *ip);
+void ip_pmtu_update(const ip_hdr_t *orig, uint16_t mtu);
 void ip_init();
 #endif
\ No newline at end of file
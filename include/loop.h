@@ -0,0 +1,10 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "config.h"
+
+int loop_init();
+void loop_wait(int events);
+void loop_close();
+
+#endif
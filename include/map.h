@@ -5,28 +5,46 @@
 #include <stdlib.h>
 #include <time.h>
 #include "config.h"
+#include "timer.h"
 
 typedef void (*map_constuctor_t)(void *dst, const void *src, size_t len);
+typedef void (*map_destructor_t)(void *value);
 typedef void (*map_entry_handler_t)(void *key, void *value, time_t *timestamp);
 
+typedef struct map_bucket //哈希索引槽，hash为0表示空槽
+{
+    uint32_t hash; //键的哈希值
+    uint32_t pos;  //键值对在条目数组中的位置
+} map_bucket_t;
+
 typedef struct map //协议栈的通用泛型map，即键值对的容器，支持超时时间与非平凡值类型
 {
     size_t key_len;                    //键的长度
     size_t value_len;                  //值的长度
+    size_t entry_len;                  //键值对(键+值+时间戳)的长度
     size_t size;                       //当前大小
-    size_t max_size;                   //最大容量
-    size_t buffer_size;
+    size_t max_size;                   //容量上限，0为不限
+    size_t capacity;                   //条目数组当前可容纳的键值对数
+    size_t bucket_mask;                //哈希索引槽数-1，槽数为2的幂，未分配时为0
     time_t timeout;                    //超时时间，0为永不超时
     map_constuctor_t value_constuctor; //形如memcpy的值构造函数，用于拷贝非平凡数据结构到容器中，如buf_copy
-    uint8_t data[MAP_MAX_LEN];         //数据
+    map_destructor_t value_destructor; //值析构函数，值被覆盖或删除前调用，如buf_free，可为NULL
+    map_entry_handler_t expire_handler; //键值对超时被回收前的回调，可为NULL
+    uint32_t lru_head, lru_tail;       //按更新时间排序的键值对链表，表头最早超时
+    net_timer_t timer;                 //表头键值对的超时定时器
+    map_bucket_t *buckets;             //Robin Hood开放寻址的哈希索引，随负载倍增或减半
+    uint8_t *entries;                  //紧凑存放的键值对数组，与索引一同伸缩，删除和伸缩时键值对会被搬移，map_get返回的指针随之失效
 } map_t;
 
-void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_len, time_t timeout, map_constuctor_t value_constuctor);
+void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_size, time_t timeout, map_constuctor_t value_constuctor, map_destructor_t value_destructor);
 size_t map_size(map_t *map);
 void *map_get(map_t *map, const void *key);
 int map_set(map_t *map, const void *key, const void *value);
 void map_delete(map_t *map, const void *key);
+void *map_oldest(map_t *map);
 void map_foreach(map_t *map, map_entry_handler_t handler);
+void map_set_expire_handler(map_t *map, map_entry_handler_t handler);
+void map_destroy(map_t *map);
 
 
-#endif
\ No newline at end of file
+#endif
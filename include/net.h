@@ -17,16 +17,45 @@ typedef enum net_protocol
 } net_protocol_t;
 
 typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
+typedef void (*net_burst_handler_t)(buf_t **bufs, uint8_t **srcs, int n);
 
 #define NET_MAC_LEN 6 //mac地址长度
 #define NET_IP_LEN 4  //ip地址长度
 
-extern uint8_t net_if_mac[NET_MAC_LEN];
-extern uint8_t net_if_ip[NET_IP_LEN];
+typedef struct net_if_stats //网卡的收发统计
+{
+    uint64_t rx_packets; // 收到的帧数
+    uint64_t rx_bytes;   // 收到的字节数
+    uint64_t tx_packets; // 发出的帧数
+    uint64_t tx_bytes;   // 发出的字节数
+    uint64_t tx_errors;  // 交给驱动失败的帧数
+} net_if_stats_t;
+
+typedef struct net_if //网卡，收到的包与要发出的包用buf_t.if_index指明所属的网卡
+{
+    uint8_t index;            // 序号，即在net_ifs中的下标
+    uint8_t mac[NET_MAC_LEN]; // mac地址
+    uint8_t ip[NET_IP_LEN];   // ip地址
+    uint8_t prefix_len;       // 所在子网的前缀长度，作为直连路由
+    uint16_t mtu;             // 最大传输单元
+    net_if_stats_t stats;     // 收发统计
+    void *driver;             // 驱动为该网卡保存的状态，未打开时为NULL
+} net_if_t;
+
+extern net_if_t net_ifs[NET_IF_MAX];
+extern int net_if_count;
 extern buf_t rxbuf, txbuf; //一个buf足够单线程使用
 
+#define net_if_mac (net_ifs[0].mac) //默认网卡，即由NET_IF_IP与NET_IF_MAC配置的第一个网卡的mac地址
+#define net_if_ip (net_ifs[0].ip)   //默认网卡的ip地址
+
+int net_if_add(const uint8_t *ip, const uint8_t *mac, uint8_t prefix_len);
+net_if_t *net_if_find(const uint8_t *ip);
 int net_init();
-void net_poll();
+int net_poll();
 int net_in(buf_t *buf, uint16_t protocol, uint8_t *src);
 void net_add_protocol(uint16_t protocol, net_handler_t handler);
+void net_add_burst_protocol(uint16_t protocol, net_burst_handler_t handler);
+int net_in_burst(buf_t **bufs, uint8_t **srcs, int n, uint16_t protocol);
+void net_in_vector(buf_t **bufs, uint8_t **srcs, const uint16_t *protocols, int n, net_handler_t fail);
 #endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include "net.h"
+#include "arp.h"
+
+#define ROUTE_TBL24_LEN (1 << 24) //一级表按地址高24位直接索引
+#define ROUTE_TBL8_LEN 256        //二级表每组按地址低8位索引
+#define ROUTE_EXT 0x8000          //一级表项最高位，置位时低15位是二级表组号
+#define ROUTE_INDEX_MASK 0x7fff   //表项低15位，下一跳号或二级表组号
+#define ROUTE_SHORT_MAX 8         //不长于此长度的前缀(如0/0默认路由)只写入按地址最高8位索引的短前缀表，不写一级表
+
+typedef struct route_nh //路由的下一跳，相同的下一跳在多条路由间共享
+{
+    uint8_t gateway[NET_IP_LEN]; // 网关地址，全0表示目的地址直连
+    uint8_t if_index;            // 出口网卡序号
+    uint8_t pad[3];              // 填充，置0
+    uint32_t refs;               // 引用它的路由数，为0表示空闲
+    arp_cache_t cache;           // 网关的mac缓存，供转发使用，直连路由不使用
+} route_nh_t;
+
+typedef struct route_key //路由规则的键，前缀中掩码之外的位为0
+{
+    uint8_t prefix[NET_IP_LEN]; // 前缀
+    uint8_t len;                // 前缀长度
+    uint8_t pad[3];             // 填充，置0
+} route_key_t;
+
+void route_init();
+int route_add(uint8_t *prefix, uint8_t len, uint8_t *gateway, uint8_t if_index);
+int route_delete(uint8_t *prefix, uint8_t len);
+size_t route_size();
+
+route_nh_t *route_lookup(const uint8_t *ip);
+
+//获取送往目的地址的数据包应交给的邻居地址：网关地址，直连时为ip本身，没有路由时为NULL
+static inline uint8_t *route_next_hop(uint8_t *ip)
+{
+    route_nh_t *nh = route_lookup(ip);
+    if (nh == NULL)
+        return NULL;
+    return *(uint32_t *)nh->gateway ? nh->gateway : ip;
+}
+
+#endif
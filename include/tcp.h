@@ -2,6 +2,7 @@
 #define TCP_H
 
 #include "net.h"
+#include "arp.h"
 
 #pragma pack(1)
 
@@ -79,6 +80,9 @@ typedef struct tcp_connect {
     void* handler;
     buf_t* rx_buf; // 接收缓存
     buf_t* tx_buf; // 发送缓存
+    uint16_t tx_sum;                 // tx_buf中从tx_sum_off起tx_sum_len字节的反码和，写入发送缓存时随拷贝一起算出
+    uint32_t tx_sum_off, tx_sum_len; // 与未发送数据的位置和长度不符时作废
+    arp_cache_t nh;                  // 缓存的下一跳，发送时不必每次查arp表
 } tcp_connect_t;
 
 static const tcp_connect_t CONNECT_LISTEN = {
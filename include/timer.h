@@ -0,0 +1,31 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include "config.h"
+
+typedef void (*timer_handler_t)(void *arg);
+
+typedef struct net_timer //侵入式定时器节点，嵌入在需要定时的对象中
+{
+    struct net_timer *next;   //同一时间槽中的下一个定时器
+    struct net_timer **pprev; //指向前驱的next指针，为NULL表示未挂在时间轮上
+    uint64_t expire;          //到期的时间轮刻度
+    uint16_t slot;            //所在的层与槽，层号在高位
+    timer_handler_t handler;  //到期回调
+    void *arg;                //回调参数
+} net_timer_t;
+
+void timer_init();
+void timer_setup(net_timer_t *timer, timer_handler_t handler, void *arg);
+void timer_arm(net_timer_t *timer, uint64_t delay_ms);
+void timer_cancel(net_timer_t *timer);
+void timer_poll();
+uint64_t timer_next_expire();
+
+//判断定时器是否已启动且尚未到期
+static inline int timer_pending(const net_timer_t *timer) {
+    return timer->pprev != NULL;
+}
+
+#endif
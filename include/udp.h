@@ -2,6 +2,7 @@
 #define UDP_H
 
 #include "net.h"
+#include "arp.h"
 
 #pragma pack(1)
 typedef struct udp_hdr
@@ -22,12 +23,22 @@ typedef struct udp_peso_hdr
 } udp_peso_hdr_t;
 #pragma pack()
 
+typedef struct udp_flow //udp发送上下文，固定的端口与目的地址，并缓存下一跳
+{
+    uint16_t src_port;              // 源端口号
+    uint16_t dst_port;              // 目的端口号
+    uint8_t dst_ip[NET_IP_LEN];     // 目的ip地址
+    arp_cache_t nh;                 // 缓存的下一跳
+} udp_flow_t;
+
 typedef void (*udp_handler_t)(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
 
 void udp_init();
 void udp_in(buf_t *buf, uint8_t *src_ip);
 void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
 void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp_flow_init(udp_flow_t *flow, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp_flow_send(udp_flow_t *flow, uint8_t *data, uint16_t len);
 int udp_open(uint16_t port, udp_handler_t handler);
 void udp_close(uint16_t port);
 #endif
\ No newline at end of file
@@ -4,8 +4,10 @@
 #include "arp.h"
 #include "ip.h"
 #include "ethernet.h"
+#include "clock.h"
+#include "timer.h"
 /**
- * @brief 初始的arp包
+ * @brief 初始的arp包，发送方地址由发出的网卡填写
  *
  */
 static const arp_pkt_t arp_init_pkt = {
@@ -13,22 +15,99 @@ static const arp_pkt_t arp_init_pkt = {
     .pro_type16 = constswap16(NET_PROTOCOL_IP),
     .hw_len = NET_MAC_LEN,
     .pro_len = NET_IP_LEN,
-    .sender_ip = NET_IF_IP,
-    .sender_mac = NET_IF_MAC,
     .target_mac = {0}};
 
 /**
- * @brief arp地址转换表，<ip,mac>的容器
+ * @brief arp地址转换表，<ip,arp_entry_t>的容器，ARP_TIMEOUT_SEC内未被确认刷新的表项被回收
  *
  */
 map_t arp_table;
 
 /**
- * @brief arp buffer，<ip,buf_t>的容器
+ * @brief 推进DELAY/PROBE状态表项的定时器，有这样的表项时才启动
+ *
+ */
+static net_timer_t arp_timer;
+
+/**
+ * @brief arp_scan遍历时记录的最早动作时间
+ *
+ */
+static uint64_t arp_next_deadline;
+
+/**
+ * @brief arp buffer，<ip,arp_pending_t>的容器，条目在ARP_MIN_INTERVAL后超时，超时后才会再次发送请求
  *
  */
 map_t arp_buf;
 
+/**
+ * @brief 邻居缓存的代数，表项的mac地址改变、失效或被回收时加一，使所有arp_cache_t失效
+ *
+ */
+uint32_t arp_generation = 1;
+
+/**
+ * @brief arp等待队列的统计计数
+ *
+ */
+arp_stats_t arp_stats;
+
+/**
+ * @brief 释放等待队列中的全部数据包，作为arp_buf的值析构函数
+ *
+ * @param value 等待队列
+ */
+static void arp_pending_free(void *value)
+{
+    arp_pending_t *pending = value;
+    for (int i = 0; i < pending->count; i++)
+        buf_free(&pending->bufs[i]);
+    pending->count = 0;
+    pending->bytes = 0;
+}
+
+/**
+ * @brief 等待队列超时，其中的数据包计为超时丢弃，随后由析构函数释放
+ *
+ * @param ip 待解析的ip地址
+ * @param value 等待队列
+ * @param timestamp 队列的建立时间
+ */
+static void arp_pending_expire(void *ip, void *value, time_t *timestamp)
+{
+    arp_stats.drop_timeout += ((arp_pending_t *)value)->count;
+}
+
+/**
+ * @brief 把数据包加入等待队列，包数或字节数超限时丢弃
+ *        与原数据包共享数据块，只有分散/聚集链或引用外部数据的包才会被拷贝
+ *
+ * @param pending 等待队列
+ * @param buf 数据包
+ * @return int 成功为0，丢弃为-1
+ */
+static int arp_pending_add(arp_pending_t *pending, buf_t *buf)
+{
+    size_t len = buf_chain_len(buf);
+    if (pending->count == ARP_PENDING_MAX_PKTS || pending->bytes + len > ARP_PENDING_MAX_BYTES)
+    {
+        arp_stats.drop_full++;
+        return -1;
+    }
+    buf_t *slot = &pending->bufs[pending->count];
+    buf_clone(slot, buf, 0);
+    if (slot->payload == NULL)
+    {
+        arp_stats.drop_nomem++;
+        return -1;
+    }
+    pending->count++;
+    pending->bytes += len;
+    arp_stats.queued++;
+    return 0;
+}
+
 /**
  * @brief 打印一条arp表项
  *
@@ -38,7 +117,9 @@ map_t arp_buf;
  */
 void arp_entry_print(void *ip, void *mac, time_t *timestamp)
 {
-    printf("%s | %s | %s\n", iptos(ip), mactos(mac), timetos(*timestamp));
+    static const char *states[] = {"reachable", "stale", "delay", "probe", "failed"};
+    // 时间戳取自单调时钟，不是日历时间，打印距今的秒数
+    printf("%s | %s | %s | %lds ago\n", iptos(ip), mactos(mac), states[((arp_entry_t *)mac)->state], (long)(clock_now() - *timestamp));
 }
 
 /**
@@ -53,40 +134,149 @@ void arp_print()
 }
 
 /**
- * @brief 发送一个arp请求
+ * @brief 在txbuf中生成一个从网卡发出的arp包，长度只有一个arp_pkt_t大小
  *
- * @param target_ip 想要知道的目标的ip地址
+ * @param netif 发出的网卡，提供发送方的ip与mac
+ * @param target_ip 目标ip地址
+ * @param opcode16 请求/响应，网络字节序
+ * @return arp_pkt_t* 生成的arp包
  */
-void arp_req(uint8_t *target_ip)
+static arp_pkt_t *arp_build(net_if_t *netif, uint8_t *target_ip, uint16_t opcode16)
 {
-    // TO-DO
-
-    // 生成新的arp包，广播，仅用于寻找目标ip，因此长度只有一个arp_pkt_t结构体大小
     buf_init(&txbuf, sizeof(arp_pkt_t));
+    txbuf.if_index = netif->index;
     arp_pkt_t *pkt = (arp_pkt_t *)txbuf.data;
     *pkt = arp_init_pkt;
+    memcpy(pkt->sender_ip, netif->ip, NET_IP_LEN);
+    memcpy(pkt->sender_mac, netif->mac, NET_MAC_LEN);
     memmove(pkt->target_ip, target_ip, NET_IP_LEN);
-    pkt->opcode16 = constswap16(ARP_REQUEST);
+    pkt->opcode16 = opcode16;
+    return pkt;
+}
+
+/**
+ * @brief 从网卡发送一个arp请求
+ *
+ * @param netif 发出请求的网卡
+ * @param target_ip 想要知道的目标的ip地址
+ */
+void arp_req(net_if_t *netif, uint8_t *target_ip)
+{
+    // TO-DO
+
+    // 生成新的arp包，广播，仅用于寻找目标ip
+    arp_build(netif, target_ip, constswap16(ARP_REQUEST));
     ethernet_out(&txbuf, ether_broadcast_mac, NET_PROTOCOL_ARP);
 }
 
 /**
- * @brief 发送一个arp响应
+ * @brief 向缓存的mac地址单播一个arp请求，确认邻居是否仍然可达
  *
+ * @param netif 邻居所在的网卡
+ * @param target_ip 目标ip地址
+ * @param target_mac 缓存的目标mac地址
+ */
+static void arp_probe(net_if_t *netif, uint8_t *target_ip, uint8_t *target_mac)
+{
+    arp_build(netif, target_ip, constswap16(ARP_REQUEST));
+    ethernet_out(&txbuf, target_mac, NET_PROTOCOL_ARP);
+}
+
+/**
+ * @brief 推进一个表项的DELAY/PROBE状态，并记录最早的下一次动作时间
+ *        DELAY到期转入PROBE，PROBE每隔ARP_PROBE_INTERVAL_MS单播一次，ARP_PROBE_MAX次无响应后转入FAILED
+ *
+ * @param ip 表项的ip地址
+ * @param value 表项
+ * @param timestamp 表项的更新时间
+ */
+static void arp_scan_entry(void *ip, void *value, time_t *timestamp)
+{
+    arp_entry_t *entry = value;
+    if (entry->state != ARP_DELAY && entry->state != ARP_PROBE)
+        return;
+    uint64_t now = clock_now_ms();
+    if (entry->deadline_ms <= now)
+    {
+        if (entry->state == ARP_PROBE && entry->probes >= ARP_PROBE_MAX)
+        {
+            entry->state = ARP_FAILED;
+            arp_generation++;
+            return;
+        }
+        entry->state = ARP_PROBE;
+        entry->probes++;
+        entry->deadline_ms = now + ARP_PROBE_INTERVAL_MS;
+        arp_probe(&net_ifs[entry->if_index], ip, entry->mac);
+    }
+    if (entry->deadline_ms < arp_next_deadline)
+        arp_next_deadline = entry->deadline_ms;
+}
+
+/**
+ * @brief arp定时器回调，推进所有DELAY/PROBE状态的表项，还有这样的表项时按最早的动作时间重新启动
+ *
+ * @param arg 未使用
+ */
+static void arp_scan(void *arg)
+{
+    arp_next_deadline = UINT64_MAX;
+    map_foreach(&arp_table, arp_scan_entry);
+    if (arp_next_deadline != UINT64_MAX)
+        timer_arm(&arp_timer, arp_next_deadline - clock_now_ms());
+}
+
+/**
+ * @brief 记录邻居可达，表项转入REACHABLE
+ *        表项的超时时间只在距上次刷新超过ARP_REACHABLE_MS时才刷新，避免频繁的确认反复改动map
+ *
+ * @param ip 邻居的ip地址
+ * @param mac 邻居的mac地址，为NULL时沿用表项中缓存的地址与网卡，表项不存在时不做任何事
+ * @param if_index 邻居所在的网卡序号
+ */
+static void arp_update(uint8_t *ip, uint8_t *mac, uint8_t if_index)
+{
+    uint64_t now = clock_now_ms();
+    arp_entry_t *entry = (arp_entry_t *)map_get(&arp_table, ip);
+    if (entry && (mac == NULL || (!memcmp(entry->mac, mac, NET_MAC_LEN) && entry->if_index == if_index)) && now - entry->refreshed_ms < ARP_REACHABLE_MS)
+    {
+        entry->state = ARP_REACHABLE;
+        entry->confirmed_ms = now;
+        return;
+    }
+    if (entry == NULL && mac == NULL)
+        return;
+    if (entry && mac && memcmp(entry->mac, mac, NET_MAC_LEN))
+        arp_generation++;
+    arp_entry_t fresh = {.state = ARP_REACHABLE, .if_index = mac ? if_index : entry->if_index, .confirmed_ms = now, .refreshed_ms = now};
+    memcpy(fresh.mac, mac ? mac : entry->mac, NET_MAC_LEN);
+    map_set(&arp_table, ip, &fresh);
+}
+
+/**
+ * @brief 上层协议(如TCP收到确认新数据的ACK)提示邻居可达，延长表项的可达时间，省去单播探测
+ *
+ * @param ip 邻居的ip地址
+ */
+void arp_confirm(uint8_t *ip)
+{
+    arp_update(ip, NULL, 0);
+}
+
+/**
+ * @brief 从网卡发送一个arp响应
+ *
+ * @param netif 发出响应的网卡
  * @param target_ip 目标ip地址
  * @param target_mac 目标mac地址
  */
-void arp_resp(uint8_t *target_ip, uint8_t *target_mac)
+void arp_resp(net_if_t *netif, uint8_t *target_ip, uint8_t *target_mac)
 {
     // TO-DO
 
-    // 生成新的arp包，发往目标，告知目标自己的mac与ip，长度只有一个arp_pkt_t大小
-    buf_init(&txbuf, sizeof(arp_pkt_t));
-    arp_pkt_t *pkt = (arp_pkt_t *)txbuf.data;
-    *pkt = arp_init_pkt;
+    // 生成新的arp包，发往目标，告知目标该网卡的mac与ip
+    arp_pkt_t *pkt = arp_build(netif, target_ip, constswap16(ARP_REPLY));
     memmove(pkt->target_mac, target_mac, NET_MAC_LEN);
-    memmove(pkt->target_ip, target_ip, NET_IP_LEN);
-    pkt->opcode16 = constswap16(ARP_REPLY);
     ethernet_out(&txbuf, target_mac, NET_PROTOCOL_ARP);
 }
 
@@ -123,27 +313,30 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
         return;
     }
 
-    // 填写arp ip表，记录ip与mac对应信息
-    map_set(&arp_table, pkt->sender_ip, src_mac);
+    // 填写arp ip表，记录ip与mac对应信息，收到对方的arp包即确认可达
+    arp_update(pkt->sender_ip, src_mac, buf->if_index);
     
-    // 查找arp 数据包表，如果存在缓存则直接发送，并删除。
-    buf_t *cache = (buf_t *)map_get(&arp_buf, pkt->sender_ip);
-        if (cache) {
-            ethernet_out(cache, src_mac, NET_PROTOCOL_IP);
-            map_delete(&arp_buf, pkt->sender_ip);
-            return;
-        }
+    // 查找arp 数据包表，如果存在等待的数据包则按到达顺序一次发出，并删除。
+    arp_pending_t *pending = (arp_pending_t *)map_get(&arp_buf, pkt->sender_ip);
+    if (pending) {
+        for (int i = 0; i < pending->count; i++)
+            ethernet_out(&pending->bufs[i], src_mac, NET_PROTOCOL_IP);
+        arp_stats.flushed += pending->count;
+        map_delete(&arp_buf, pkt->sender_ip);
+        return;
+    }
 
-    // 否则判断是否为arp请求报文，进行发送
-    if (pkt->opcode16 == constswap16(ARP_REQUEST) && !memcmp(pkt->target_ip, net_if_ip, NET_IP_LEN))
+    // 否则判断是否为询问收到请求的网卡的arp请求报文，进行发送
+    net_if_t *netif = &net_ifs[buf->if_index];
+    if (pkt->opcode16 == constswap16(ARP_REQUEST) && !memcmp(pkt->target_ip, netif->ip, NET_IP_LEN))
     {
-        arp_resp(pkt->sender_ip, src_mac);
+        arp_resp(netif, pkt->sender_ip, src_mac);
         return;
     }
 }
 
 /**
- * @brief 处理一个要发送的数据包
+ * @brief 处理一个要发送的数据包，未解析时从buf->if_index指明的网卡发出请求
  *
  * @param buf 要处理的数据包
  * @param ip 目标ip地址
@@ -153,27 +346,79 @@ void arp_out(buf_t *buf, uint8_t *ip)
 {
     // TO-DO
     
-    uint8_t *dst_mac;
+    // 查表，除FAILED外都直接发送；可达时间已过的表项被使用时转入DELAY，等待确认或到期后单播探测，发送不会因此停顿
+    arp_entry_t *entry = (arp_entry_t *)map_get(&arp_table, ip);
+    if (entry && entry->state != ARP_FAILED)
+    {
+        uint64_t now = clock_now_ms();
+        if (entry->state == ARP_REACHABLE && now - entry->confirmed_ms >= ARP_REACHABLE_MS)
+            entry->state = ARP_STALE;
+        if (entry->state == ARP_STALE)
+        {
+            entry->state = ARP_DELAY;
+            entry->deadline_ms = now + ARP_DELAY_MS;
+            if (!timer_pending(&arp_timer))
+                timer_arm(&arp_timer, ARP_DELAY_MS);
+        }
+        ethernet_out(buf, entry->mac, NET_PROTOCOL_IP);
+        return;
+    }
 
-    // 查表，直接发送
-    if ((dst_mac = (uint8_t *)map_get(&arp_table, ip)) != NULL)
+    // 不在arp表中，已有等待队列说明请求已经发出，只需排队
+    arp_pending_t *pending = (arp_pending_t *)map_get(&arp_buf, ip);
+    if (pending)
     {
-        ethernet_out(buf, dst_mac, NET_PROTOCOL_IP);
+        arp_pending_add(pending, buf);
         return;
     }
 
-    // 不在arp表中，查看cache中是否有数据。
-    // 若cache中无数据，则说明是新ip，发送获取ip的请求
-    buf_t *cache = (buf_t *)map_get(&arp_buf, ip);
+    // 新ip，建立等待队列并发送获取ip的请求
+    arp_pending_t fresh = {0};
+    if (map_set(&arp_buf, ip, &fresh) == 0)
+        arp_pending_add((arp_pending_t *)map_get(&arp_buf, ip), buf);
+    else
+        arp_stats.drop_nomem++;
 
-    
-    if (cache)
+    arp_req(&net_ifs[buf->if_index], ip);
+}
+
+/**
+ * @brief 经由缓存的下一跳发送数据包，缓存有效时不查表
+ *        缓存无效或可能过期时走arp_out推进表项状态，表项REACHABLE时重新填入缓存
+ *
+ * @param buf 要处理的数据包
+ * @param ip 目标ip地址
+ * @param cache 下一跳缓存，初始全为0
+ */
+void arp_out_cached(buf_t *buf, uint8_t *ip, arp_cache_t *cache)
+{
+    if (cache->gen == arp_generation && clock_now_ms() < cache->expire_ms)
+    {
+        ethernet_out(buf, cache->mac, NET_PROTOCOL_IP);
         return;
+    }
+    arp_out(buf, ip);
+    arp_entry_t *entry = (arp_entry_t *)map_get(&arp_table, ip);
+    if (entry && entry->state == ARP_REACHABLE)
+    {
+        memcpy(cache->mac, entry->mac, NET_MAC_LEN);
+        cache->gen = arp_generation;
+        cache->expire_ms = entry->confirmed_ms + ARP_REACHABLE_MS;
+    }
+    else
+        cache->gen = 0;
+}
 
-    // 使用cache容量为1， 则只有cache中无内容时才将数据填入cache
-    map_set(&arp_buf, ip, buf);
-    
-    arp_req(ip);
+/**
+ * @brief 表项超时被回收，使缓存的下一跳失效
+ *
+ * @param ip 表项的ip地址
+ * @param value 表项
+ * @param timestamp 表项的更新时间
+ */
+static void arp_entry_expire(void *ip, void *value, time_t *timestamp)
+{
+    arp_generation++;
 }
 
 /**
@@ -182,8 +427,12 @@ void arp_out(buf_t *buf, uint8_t *ip)
  */
 void arp_init()
 {
-    map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
-    map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
+    map_init(&arp_table, NET_IP_LEN, sizeof(arp_entry_t), 0, ARP_TIMEOUT_SEC, NULL, NULL);
+    map_set_expire_handler(&arp_table, arp_entry_expire);
+    timer_setup(&arp_timer, arp_scan, NULL);
+    map_init(&arp_buf, NET_IP_LEN, sizeof(arp_pending_t), 0, ARP_MIN_INTERVAL, NULL, arp_pending_free);
+    map_set_expire_handler(&arp_buf, arp_pending_expire);
     net_add_protocol(NET_PROTOCOL_ARP, arp_in);
-    arp_req(net_if_ip);
+    for (int i = 0; i < net_if_count; i++)
+        arp_req(&net_ifs[i], net_ifs[i].ip);
 }
\ No newline at end of file
@@ -1,13 +1,104 @@
 #include "buf.h"
+#include "utils.h"
+#include "checksum.h"
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat="
 #pragma GCC diagnostic ignored "-Wformat-extra-args"
+/**
+ * @brief buffer池的空闲数据块链表
+ * 
+ */
+static buf_mem_t *buf_pool;
+
+/**
+ * @brief 内部函数，分配一个至少能容纳size字节的数据块，引用计数为1
+ *        不超过池数据块容量的从池中取，否则单独分配，释放时直接归还系统
+ * 
+ * @param size 需要的数据区容量
+ * @return buf_mem_t* 数据块，内存不足为NULL
+ */
+static buf_mem_t *buf_mem_get(size_t size)
+{
+    const size_t pool_size = BUF_BLOCK_LEN - offsetof(buf_mem_t, payload);
+    buf_mem_t *mem;
+    if (size > pool_size)
+    {
+        size_t len = (offsetof(buf_mem_t, payload) + size + BUF_ALIGN - 1) / BUF_ALIGN * BUF_ALIGN;
+        if ((mem = aligned_alloc(BUF_ALIGN, len)) == NULL)
+            return NULL;
+        mem->size = len - offsetof(buf_mem_t, payload);
+    }
+    else
+    {
+        if (buf_pool == NULL)
+        { // 一次扩充一批数据块，避免逐个分配
+            uint8_t *slab = aligned_alloc(BUF_ALIGN, BUF_POOL_GROW * BUF_BLOCK_LEN);
+            if (slab == NULL)
+                return NULL;
+            for (int i = 0; i < BUF_POOL_GROW; i++)
+            {
+                buf_mem_t *block = (buf_mem_t *)(slab + i * BUF_BLOCK_LEN);
+                block->next = buf_pool;
+                buf_pool = block;
+            }
+        }
+        mem = buf_pool;
+        buf_pool = mem->next;
+        mem->size = pool_size;
+    }
+    mem->next = NULL;
+    mem->ref = 1;
+    return mem;
+}
+
+/**
+ * @brief 内部函数，释放对数据块的一次引用，最后一次引用释放时归还数据块
+ * 
+ * @param mem 数据块
+ */
+static void buf_mem_put(buf_mem_t *mem)
+{
+    if (--mem->ref)
+        return;
+    if (mem->size > BUF_BLOCK_LEN - offsetof(buf_mem_t, payload))
+    {
+        free(mem);
+        return;
+    }
+    mem->next = buf_pool;
+    buf_pool = mem;
+}
+
+/**
+ * @brief 内部函数，保证buffer独占一个数据区不小于size的数据块
+ *        与其他buffer共享的数据块不会被改写，而是换成新的数据块
+ * 
+ * @param buf 要操作的buffer
+ * @param size 需要的数据区容量
+ * @return int 成功为0，失败为-1
+ */
+static int buf_reserve(buf_t *buf, size_t size)
+{
+    if (buf->mem && buf->mem->ref == 1 && buf->mem->size >= size)
+        return 0;
+    buf_mem_t *mem = buf_mem_get(size);
+    if (mem == NULL)
+        return -1;
+    buf_free(buf);
+    buf->mem = mem;
+    buf->payload = mem->payload;
+    buf->size = mem->size;
+    return 0;
+}
+
 /**
  * @brief 初始化buffer为给定的长度，用于装载数据包
+ *        数据前预留BUF_HEADROOM字节的协议头空间
  * 
  * @param buf 要初始化的buffer
  * @param len 数据初始长度
@@ -15,17 +106,265 @@
  */
 int buf_init(buf_t *buf, size_t len)
 {
-    if (len >= BUF_MAX_LEN / 2)
+    if (len >= BUF_MAX_LEN / 2 || buf_reserve(buf, BUF_HEADROOM + len) == -1)
     {
         fprintf(stderr, "Error in buf_init:%zu\n", len);
         return -1;
     }
 
     buf->len = len;
-    buf->data = buf->payload + BUF_MAX_LEN / 2 - len;
+    buf->data = buf->payload + BUF_HEADROOM;
+    buf->next = NULL;
+    buf->csum_flags = 0;
+    buf->if_index = 0;
+    buf->l2_bcast = 0;
+    return 0;
+}
+
+/**
+ * @brief 初始化一个空buffer，并保证数据之后至少还能追加size字节
+ *        用于收发缓存等需要在尾部持续追加数据的场合
+ * 
+ * @param buf 要初始化的buffer
+ * @param size 数据区容量
+ * @return int 成功为0，失败为-1
+ */
+int buf_alloc(buf_t *buf, size_t size)
+{
+    if (buf_reserve(buf, BUF_HEADROOM + size) == -1)
+    {
+        fprintf(stderr, "Error in buf_alloc:%zu\n", size);
+        return -1;
+    }
+    buf->len = 0;
+    buf->data = buf->payload + BUF_HEADROOM;
+    buf->next = NULL;
     return 0;
 }
 
+/**
+ * @brief 释放buffer对数据块的引用
+ * 
+ * @param buf 要释放的buffer
+ */
+void buf_free(buf_t *buf)
+{
+    if (buf->mem)
+        buf_mem_put(buf->mem);
+    buf->mem = NULL;
+    buf->payload = buf->data = NULL;
+    buf->size = buf->len = 0;
+    buf->next = NULL;
+}
+
+/**
+ * @brief 初始化一个引用外部数据的buffer段，不拷贝数据也不持有数据
+ *        用于把应用层或其他buffer中的数据直接挂到分散/聚集链上
+ * 
+ * @param buf 要初始化的buffer段，视为未初始化
+ * @param data 外部数据
+ * @param len 数据长度
+ */
+void buf_init_ref(buf_t *buf, uint8_t *data, size_t len)
+{
+    buf->mem = NULL;
+    buf->payload = buf->data = data;
+    buf->size = buf->len = len;
+    buf->next = NULL;
+    buf->csum_flags = 0;
+    buf->if_index = 0;
+    buf->l2_bcast = 0;
+}
+
+/**
+ * @brief 计算分散/聚集链的总长度
+ * 
+ * @param buf 链的第一段
+ * @return size_t 各段有效数据长度之和
+ */
+size_t buf_chain_len(const buf_t *buf)
+{
+    size_t len = 0;
+    for (; buf; buf = buf->next)
+        len += buf->len;
+    return len;
+}
+
+/**
+ * @brief 把分散/聚集链的数据依次拷贝到连续内存中
+ * 
+ * @param buf 链的第一段
+ * @param dst 目的内存
+ * @param max 目的内存大小
+ * @return size_t 拷贝的字节数，空间不足为0
+ */
+size_t buf_gather(const buf_t *buf, uint8_t *dst, size_t max)
+{
+    size_t len = buf_chain_len(buf);
+    if (len > max)
+        return 0;
+    for (; buf; buf = buf->next)
+    {
+        memcpy(dst, buf->data, buf->len);
+        dst += buf->len;
+    }
+    return len;
+}
+
+/**
+ * @brief 生成引用链中[offset, offset + len)这段数据的新链，不拷贝数据
+ * 
+ * @param segs 存放新链各段的数组，新链从segs[0]开始
+ * @param max 数组大小
+ * @param src 源链的第一段
+ * @param offset 起始偏移
+ * @param len 长度
+ * @return int 新链的段数，越界或数组不足为-1
+ */
+int buf_slice(buf_t *segs, size_t max, const buf_t *src, size_t offset, size_t len)
+{
+    size_t n = 0;
+    for (; src && offset >= src->len; src = src->next)
+        offset -= src->len;
+    for (; src && len; src = src->next, offset = 0)
+    {
+        if (n == max)
+            return -1;
+        size_t size = src->len - offset < len ? src->len - offset : len;
+        buf_init_ref(&segs[n], src->data + offset, size);
+        if (n)
+            segs[n - 1].next = &segs[n];
+        n++;
+        len -= size;
+    }
+    return len ? -1 : (int)n;
+}
+
+/**
+ * @brief 把分散/聚集链合并为一个独占数据块中的连续数据，保留第一段的头部空间
+ * 
+ * @param buf 链的第一段，合并后不再有后续段
+ * @return int 成功为0，失败为-1
+ */
+int buf_linearize(buf_t *buf)
+{
+    if (buf->next == NULL && buf->mem)
+        return 0;
+    size_t headroom = buf->mem ? (size_t)(buf->data - buf->payload) : BUF_HEADROOM;
+    size_t len = buf_chain_len(buf);
+    buf_mem_t *mem = buf_mem_get(headroom + len);
+    if (mem == NULL)
+    {
+        fprintf(stderr, "Error in buf_linearize:%zu\n", len);
+        return -1;
+    }
+    buf_gather(buf, mem->payload + headroom, len);
+    buf_free(buf);
+    buf->mem = mem;
+    buf->payload = mem->payload;
+    buf->size = mem->size;
+    buf->data = mem->payload + headroom;
+    buf->len = len;
+    return 0;
+}
+
+/**
+ * @brief 计算分散/聚集链上全部数据的16位校验和，与checksum16对连续数据的结果相同
+ *        各段长度可以为奇数
+ * 
+ * @param buf 链的第一段
+ * @return uint16_t 校验和
+ */
+uint16_t buf_checksum16(const buf_t *buf)
+{
+    uint16_t sum = 0;
+    size_t offset = 0;
+    for (; buf; buf = buf->next)
+    {
+        sum = checksum_combine(sum, checksum_sum16(buf->data, buf->len), offset);
+        offset += buf->len;
+    }
+    return ~sum;
+}
+
+/**
+ * @brief 标记buffer的校验和留待发送时补全，并在校验和字段中预先填入伪头部的反码和
+ *        校验和字段必须位于第一段内
+ * 
+ * @param buf 链的第一段
+ * @param start 校验范围相对data的起点
+ * @param offset 校验和字段相对start的偏移
+ * @param sum 伪头部的反码和(未取反)
+ */
+void buf_csum_partial(buf_t *buf, size_t start, size_t offset, uint16_t sum)
+{
+    assert(start + offset + sizeof(sum) <= buf->len);
+    memcpy(buf->data + start + offset, &sum, sizeof(sum));
+    buf->csum_flags |= BUF_CSUM_PARTIAL;
+    buf->csum_start = start;
+    buf->csum_offset = offset;
+}
+
+/**
+ * @brief 在软件中补全标记了BUF_CSUM_PARTIAL的校验和并清除标记，用于无法留到发送时的情况(如分片)
+ * 
+ * @param buf 链的第一段
+ * @return int 成功为0，校验范围不在链内为-1
+ */
+int buf_csum_resolve(buf_t *buf)
+{
+    if (!(buf->csum_flags & BUF_CSUM_PARTIAL))
+        return 0;
+    if ((size_t)buf->csum_start + buf->csum_offset + 2 > buf->len)
+        return -1;
+    uint16_t sum = checksum_sum16(buf->data + buf->csum_start, buf->len - buf->csum_start);
+    size_t offset = buf->len - buf->csum_start;
+    for (const buf_t *seg = buf->next; seg; seg = seg->next)
+    {
+        sum = checksum_combine(sum, checksum_sum16(seg->data, seg->len), offset);
+        offset += seg->len;
+    }
+    sum = ~sum;
+    memcpy(buf->data + buf->csum_start + buf->csum_offset, &sum, sizeof(sum));
+    buf->csum_flags &= ~BUF_CSUM_PARTIAL;
+    return 0;
+}
+
+/**
+ * @brief 与buf_gather相同，标记了BUF_CSUM_PARTIAL时在拷贝的同时求校验和，写入dst中的校验和字段
+ *        供驱动在发送时使用，数据只读一遍，buf本身不被改写
+ * 
+ * @param buf 链的第一段
+ * @param dst 目的地址
+ * @param max 目的空间大小
+ * @return size_t 拷贝的字节数，链的总长度超过max或校验和字段不在第一段内时不拷贝并返回0
+ */
+size_t buf_gather_csum(const buf_t *buf, uint8_t *dst, size_t max)
+{
+    if (!(buf->csum_flags & BUF_CSUM_PARTIAL))
+        return buf_gather(buf, dst, max);
+    size_t len = buf_chain_len(buf);
+    size_t field = (size_t)buf->csum_start + buf->csum_offset;
+    if (len > max || field + 2 > buf->len)
+        return 0;
+    size_t skip = buf->csum_start, offset = 0;
+    uint16_t sum = 0;
+    for (uint8_t *p = dst; buf; p += buf->len, buf = buf->next)
+    {
+        size_t head = skip < buf->len ? skip : buf->len;
+        memcpy(p, buf->data, head);
+        skip -= head;
+        if (head < buf->len)
+        {
+            sum = checksum_combine(sum, checksum_copy16(p + head, buf->data + head, buf->len - head), offset);
+            offset += buf->len - head;
+        }
+    }
+    sum = ~sum;
+    memcpy(dst + field, &sum, sizeof(sum));
+    return len;
+}
+
 /**
  * @brief 为buffer在头部增加一段长度，用于添加协议头
  * 
@@ -42,6 +381,8 @@ int buf_add_header(buf_t *buf, size_t len)
     }
     buf->len += len;
     buf->data -= len;
+    if (buf->csum_flags & BUF_CSUM_PARTIAL)
+        buf->csum_start += len;
     return 0;
 }
 
@@ -61,6 +402,8 @@ int buf_remove_header(buf_t *buf, size_t len)
     }
     buf->len -= len;
     buf->data += len;
+    if (buf->csum_flags & BUF_CSUM_PARTIAL)
+        buf->csum_start -= len;
     return 0;
 }
 
@@ -73,7 +416,7 @@ int buf_remove_header(buf_t *buf, size_t len)
  */
 int buf_add_padding(buf_t *buf, size_t len)
 {
-    if (buf->data + buf->len + len >= buf->payload + BUF_MAX_LEN)
+    if (buf->data + buf->len + len > buf->payload + buf->size)
     {
         fprintf(stderr, "Error in buf_add_padding:%zu+%zu\n", buf->len, len);
         return -1;
@@ -102,9 +445,9 @@ int buf_remove_padding(buf_t *buf, size_t len)
 }
 
 /**
- * @brief buf拷贝构造函数
+ * @brief buf拷贝构造函数，把有效数据(包括整条分散/聚集链)复制到新的数据块，保留相同的头部空间
  * 
- * @param pdst 目的buffer
+ * @param pdst 目的buffer，视为未初始化
  * @param psrc 源buffer
  * @param len 占位用，与memcpy保持形式一致，无意义
  */
@@ -112,12 +455,49 @@ void buf_copy(void *pdst, const void *psrc, size_t len)
 {
     buf_t *dst = pdst;
     const buf_t *src = psrc;
+    dst->mem = NULL;
+    dst->next = NULL;
+    size_t headroom = src->mem ? (size_t)(src->data - src->payload) : BUF_HEADROOM;
+    size_t total = buf_chain_len(src);
+    size_t size = src->mem && src->size > headroom + total ? src->size : headroom + total;
+    if (src->payload == NULL || buf_reserve(dst, size) == -1)
+    {
+        buf_free(dst);
+        return;
+    }
     assert(src->data >= src->payload);
-    assert(src->len <= BUF_MAX_LEN);
-    assert(src->data + src->len < src->payload + BUF_MAX_LEN);
-    dst->len = src->len;
-    dst->data = dst->payload + (src->data - src->payload);
-    memcpy(dst->payload, src->payload, BUF_MAX_LEN);
+    assert(src->data + src->len <= src->payload + src->size);
+    dst->len = total;
+    dst->data = dst->payload + headroom;
+    buf_gather(src, dst->data, total);
+    dst->csum_flags = src->csum_flags;
+    dst->if_index = src->if_index;
+    dst->l2_bcast = src->l2_bcast;
+    dst->csum_start = src->csum_start;
+    dst->csum_offset = src->csum_offset;
+}
+
+/**
+ * @brief buf浅拷贝构造函数，与源buffer共享数据块，只增加引用计数
+ *        共享的数据块在buf_init时会被替换，不会被改写
+ *        分散/聚集链或引用外部数据的buffer不能共享，退化为buf_copy
+ * 
+ * @param pdst 目的buffer，视为未初始化
+ * @param psrc 源buffer
+ * @param len 占位用，与memcpy保持形式一致，无意义
+ */
+void buf_clone(void *pdst, const void *psrc, size_t len)
+{
+    buf_t *dst = pdst;
+    const buf_t *src = psrc;
+    if (src->next || (src->mem == NULL && src->payload))
+    {
+        buf_copy(dst, src, len);
+        return;
+    }
+    *dst = *src;
+    if (dst->mem)
+        dst->mem->ref++;
 }
 
 #pragma GCC diagnostic pop
@@ -0,0 +1,377 @@
+#include <string.h>
+#include "checksum.h"
+
+#define CHECKSUM_VECTOR_MIN 64 //短于此长度的数据直接用标量实现
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHECKSUM_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief 内部函数，带循环进位的64位加法，反码和的高位进位加回最低位
+ *
+ * @param sum 累加值
+ * @param x 加数
+ * @return uint64_t 新的累加值
+ */
+static inline uint64_t checksum_add64(uint64_t sum, uint64_t x)
+{
+    sum += x;
+    return sum + (sum < x);
+}
+
+/**
+ * @brief 内部函数，把64位反码和折叠成16位
+ *
+ * @param sum 64位反码和
+ * @return uint16_t 16位反码和
+ */
+static inline uint16_t checksum_fold(uint64_t sum)
+{
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    while (sum >> 16)
+        sum = (sum >> 16) + (sum & 0xffff);
+    return sum;
+}
+
+/**
+ * @brief 内部函数，以64位为单位累加数据，dst非NULL时同时把数据拷贝到dst
+ *        反码和与字节序无关，按更宽的字累加再折叠与逐个16位字累加的结果相同
+ *
+ * @param sum 初始累加值
+ * @param dst 拷贝目标，为NULL时只累加
+ * @param p 数据，不要求对齐
+ * @param len 长度，可以为奇数
+ * @return uint64_t 新的累加值
+ */
+static inline __attribute__((always_inline)) uint64_t checksum_add_generic(uint64_t sum, uint8_t *dst, const uint8_t *p, size_t len)
+{
+    uint64_t a = 0, b = 0, x, y;
+    for (; len >= 16; p += 16, len -= 16)
+    { // 两条独立的进位链，减少相邻加法之间的依赖
+        memcpy(&x, p, 8);
+        memcpy(&y, p + 8, 8);
+        if (dst)
+        {
+            memcpy(dst, &x, 8);
+            memcpy(dst + 8, &y, 8);
+            dst += 16;
+        }
+        a = checksum_add64(a, x);
+        b = checksum_add64(b, y);
+    }
+    sum = checksum_add64(sum, checksum_add64(a, b));
+    // 尾部按8、4、2、1字节逐段累加，每段都从偶数偏移开始，各自作为完整的字参与反码和
+    if (len & 8)
+    {
+        memcpy(&x, p, 8);
+        sum = checksum_add64(sum, x);
+        p += 8;
+        if (dst)
+            memcpy(dst, &x, 8), dst += 8;
+    }
+    if (len & 4)
+    {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        sum = checksum_add64(sum, w);
+        p += 4;
+        if (dst)
+            memcpy(dst, &w, 4), dst += 4;
+    }
+    if (len & 2)
+    {
+        uint16_t w;
+        memcpy(&w, p, 2);
+        sum = checksum_add64(sum, w);
+        p += 2;
+        if (dst)
+            memcpy(dst, &w, 2), dst += 2;
+    }
+    if (len & 1)
+    {
+        uint16_t w = 0; // 最后一个字节按内存顺序补0
+        memcpy(&w, p, 1);
+        sum = checksum_add64(sum, w);
+        if (dst)
+            *dst = *p;
+    }
+    return sum;
+}
+
+static uint16_t checksum_sum16_generic(const void *data, size_t len)
+{
+    return checksum_fold(checksum_add_generic(0, NULL, data, len));
+}
+
+static uint16_t checksum_copy16_generic(void *dst, const void *src, size_t len)
+{
+    return checksum_fold(checksum_add_generic(0, dst, src, len));
+}
+
+#ifdef CHECKSUM_X86
+/**
+ * @brief 内部函数，SSE2实现，每次载入32字节，把32位字零扩展后加到64位累加器
+ *        64位累加器加32位数，2^32次内不会溢出，循环中无需处理进位
+ *
+ */
+static inline __attribute__((always_inline, target("sse2"))) uint16_t checksum_sse2(uint8_t *dst, const uint8_t *p, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+    for (; len >= 32; p += 32, len -= 32)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i w = _mm_loadu_si128((const __m128i *)(p + 16));
+        if (dst)
+        {
+            _mm_storeu_si128((__m128i *)dst, v);
+            _mm_storeu_si128((__m128i *)(dst + 16), w);
+            dst += 32;
+        }
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+        acc2 = _mm_add_epi64(acc2, _mm_unpacklo_epi32(w, zero));
+        acc3 = _mm_add_epi64(acc3, _mm_unpackhi_epi32(w, zero));
+    }
+    uint64_t lane[4];
+    _mm_storeu_si128((__m128i *)lane, _mm_add_epi64(acc0, acc1));
+    _mm_storeu_si128((__m128i *)(lane + 2), _mm_add_epi64(acc2, acc3));
+    uint64_t sum = 0;
+    for (int i = 0; i < 4; i++)
+        sum = checksum_add64(sum, lane[i]);
+    return checksum_fold(checksum_add_generic(sum, dst, p, len));
+}
+
+__attribute__((target("sse2"))) static uint16_t checksum_sum16_sse2(const void *data, size_t len)
+{
+    return checksum_sse2(NULL, data, len);
+}
+
+__attribute__((target("sse2"))) static uint16_t checksum_copy16_sse2(void *dst, const void *src, size_t len)
+{
+    return checksum_sse2(dst, src, len);
+}
+
+/**
+ * @brief 内部函数，AVX2实现，每次载入64字节，方法与SSE2实现相同
+ *
+ */
+static inline __attribute__((always_inline, target("avx2"))) uint16_t checksum_avx2(uint8_t *dst, const uint8_t *p, size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+    for (; len >= 64; p += 64, len -= 64)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i w = _mm256_loadu_si256((const __m256i *)(p + 32));
+        if (dst)
+        {
+            _mm256_storeu_si256((__m256i *)dst, v);
+            _mm256_storeu_si256((__m256i *)(dst + 32), w);
+            dst += 64;
+        }
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+        acc2 = _mm256_add_epi64(acc2, _mm256_unpacklo_epi32(w, zero));
+        acc3 = _mm256_add_epi64(acc3, _mm256_unpackhi_epi32(w, zero));
+    }
+    acc0 = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1), _mm256_add_epi64(acc2, acc3));
+    uint64_t lane[4];
+    _mm256_storeu_si256((__m256i *)lane, acc0);
+    uint64_t sum = 0;
+    for (int i = 0; i < 4; i++)
+        sum = checksum_add64(sum, lane[i]);
+    return checksum_fold(checksum_add_generic(sum, dst, p, len));
+}
+
+__attribute__((target("avx2"))) static uint16_t checksum_sum16_avx2(const void *data, size_t len)
+{
+    return checksum_avx2(NULL, data, len);
+}
+
+__attribute__((target("avx2"))) static uint16_t checksum_copy16_avx2(void *dst, const void *src, size_t len)
+{
+    return checksum_avx2(dst, src, len);
+}
+#endif
+
+/**
+ * @brief 可选的实现，按优先级从高到低排列
+ *
+ */
+static const struct
+{
+    const char *name;
+    checksum_fn_t fn;
+    checksum_copy_fn_t copy;
+} checksum_impls[] = {
+#ifdef CHECKSUM_X86
+    {"avx2", checksum_sum16_avx2, checksum_copy16_avx2},
+    {"sse2", checksum_sum16_sse2, checksum_copy16_sse2},
+#endif
+    {"generic", checksum_sum16_generic, checksum_copy16_generic},
+};
+
+#define CHECKSUM_IMPL_NUM (sizeof(checksum_impls) / sizeof(checksum_impls[0]))
+
+/**
+ * @brief 内部函数，判断CPU是否支持某个实现
+ *
+ * @param i 实现在checksum_impls中的下标
+ * @return int 支持为1
+ */
+static int checksum_supported(size_t i)
+{
+#ifdef CHECKSUM_X86
+    __builtin_cpu_init();
+    if (!strcmp(checksum_impls[i].name, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    if (!strcmp(checksum_impls[i].name, "sse2"))
+        return __builtin_cpu_supports("sse2");
+#endif
+    return 1;
+}
+
+static uint16_t checksum_sum16_resolve(const void *data, size_t len);
+static uint16_t checksum_copy16_resolve(void *dst, const void *src, size_t len);
+
+/**
+ * @brief 当前使用的实现，第一次调用时按CPUID选择
+ *
+ */
+static checksum_fn_t checksum_fn = checksum_sum16_resolve;
+static checksum_copy_fn_t checksum_copy_fn = checksum_copy16_resolve;
+static const char *checksum_name;
+
+/**
+ * @brief 内部函数，第一次计算时选择CPU支持的最快实现
+ *
+ */
+static uint16_t checksum_sum16_resolve(const void *data, size_t len)
+{
+    checksum_select(NULL);
+    return checksum_fn(data, len);
+}
+
+static uint16_t checksum_copy16_resolve(void *dst, const void *src, size_t len)
+{
+    checksum_select(NULL);
+    return checksum_copy_fn(dst, src, len);
+}
+
+/**
+ * @brief 计算一段数据的16位反码和(未取反)，与逐个16位字累加的结果相同
+ *        起始地址不要求对齐，长度可以为奇数，最后一个字节按内存顺序补0
+ *
+ * @param data 数据
+ * @param len 长度
+ * @return uint16_t 折叠后的反码和
+ */
+uint16_t checksum_sum16(const void *data, size_t len)
+{
+    if (len < CHECKSUM_VECTOR_MIN) // ip头等短数据不值得进入向量实现
+        return checksum_sum16_generic(data, len);
+    return checksum_fn(data, len);
+}
+
+/**
+ * @brief 拷贝一段数据并同时计算它的16位反码和(未取反)，每个字节只读一次
+ *        用于负载在缓存之间搬移的同时需要校验和的场合，结果与checksum_sum16相同
+ *
+ * @param dst 拷贝目标，不能与src重叠
+ * @param src 数据
+ * @param len 长度
+ * @return uint16_t 折叠后的反码和
+ */
+uint16_t checksum_copy16(void *dst, const void *src, size_t len)
+{
+    if (len < CHECKSUM_VECTOR_MIN)
+        return checksum_copy16_generic(dst, src, len);
+    return checksum_copy_fn(dst, src, len);
+}
+
+/**
+ * @brief 合并相邻两段数据的反码和，用于分段计算的数据
+ *        从奇数偏移开始的一段，其中每个字的高低字节与整体计算时相反，需要对调
+ *
+ * @param sum 前面各段的反码和(未取反)
+ * @param part 这一段的反码和(未取反)
+ * @param offset 这一段相对整体开头的偏移
+ * @return uint16_t 合并后的反码和(未取反)
+ */
+uint16_t checksum_combine(uint16_t sum, uint16_t part, size_t offset)
+{
+    uint32_t total = (uint32_t)sum + (offset & 1 ? (uint16_t)(part << 8 | part >> 8) : part);
+    return (total >> 16) + (total & 0xffff);
+}
+
+/**
+ * @brief 一个16位字段改变后增量更新校验和(RFC 1624)，不必重新计算整个报文
+ *        HC' = ~(~HC + ~m + m')，字段与校验和都按报文中的字节序直接读出即可
+ *
+ * @param check 原校验和
+ * @param old_word 字段原值
+ * @param new_word 字段新值
+ * @return uint16_t 新校验和
+ */
+uint16_t checksum_adjust16(uint16_t check, uint16_t old_word, uint16_t new_word)
+{
+    uint32_t sum = (uint16_t)~check + (uint16_t)~old_word + new_word;
+    while (sum >> 16)
+        sum = (sum >> 16) + (sum & 0xffff);
+    return ~sum;
+}
+
+/**
+ * @brief 一个从偶数偏移开始的32位字段改变后增量更新校验和，如ip地址
+ *
+ * @param check 原校验和
+ * @param old_word 字段原值
+ * @param new_word 字段新值
+ * @return uint16_t 新校验和
+ */
+uint16_t checksum_adjust32(uint16_t check, uint32_t old_word, uint32_t new_word)
+{
+    check = checksum_adjust16(check, old_word >> 16, new_word >> 16);
+    return checksum_adjust16(check, old_word & 0xffff, new_word & 0xffff);
+}
+
+/**
+ * @brief 指定校验和的实现，用于测试与性能对比
+ *
+ * @param name 实现名，可以是avx2、sse2或generic，为NULL时选择CPU支持的最快实现
+ * @return int 成功为0，不存在或CPU不支持为-1
+ */
+int checksum_select(const char *name)
+{
+    for (size_t i = 0; i < CHECKSUM_IMPL_NUM; i++)
+    {
+        if (name && strcmp(name, checksum_impls[i].name))
+            continue;
+        if (!checksum_supported(i))
+        {
+            if (name)
+                return -1;
+            continue;
+        }
+        checksum_fn = checksum_impls[i].fn;
+        checksum_copy_fn = checksum_impls[i].copy;
+        checksum_name = checksum_impls[i].name;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief 获取当前使用的实现名
+ *
+ * @return const char* 实现名
+ */
+const char *checksum_selected()
+{
+    if (checksum_name == NULL)
+        checksum_select(NULL);
+    return checksum_name;
+}
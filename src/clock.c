@@ -0,0 +1,77 @@
+#include <stddef.h>
+#include "clock.h"
+
+/**
+ * @brief 缓存的协议栈时钟(毫秒)，热路径只读取这个值而不做系统调用
+ *
+ */
+uint64_t clock_ms;
+
+/**
+ * @brief 读取系统单调时钟，定时器不受NTP等对系统时间的调整影响
+ *
+ * @return uint64_t 毫秒时间戳，起点不确定，只能用于计算时间差
+ */
+static uint64_t clock_source_real(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 当前时钟源，为NULL表示虚拟时钟，只随clock_set_virtual/clock_advance变化
+ *
+ */
+static clock_source_t clock_source = clock_source_real;
+
+/**
+ * @brief 初始化协议栈时钟
+ *
+ */
+void clock_init()
+{
+    clock_update();
+}
+
+/**
+ * @brief 从时钟源刷新一次缓存的时钟，每次协议栈轮询调用一次
+ *
+ */
+void clock_update()
+{
+    if (clock_source)
+        clock_ms = clock_source();
+}
+
+/**
+ * @brief 设置时钟源并立即刷新
+ *
+ * @param source 时钟源，为NULL则恢复系统单调时钟
+ */
+void clock_set_source(clock_source_t source)
+{
+    clock_source = source ? source : clock_source_real;
+    clock_update();
+}
+
+/**
+ * @brief 切换到虚拟时钟模式并设置当前时间，离线测试用它保证结果可复现
+ *
+ * @param now_ms 虚拟时间(毫秒)
+ */
+void clock_set_virtual(uint64_t now_ms)
+{
+    clock_source = NULL;
+    clock_ms = now_ms;
+}
+
+/**
+ * @brief 推进虚拟时钟
+ *
+ * @param delta_ms 推进的毫秒数
+ */
+void clock_advance(uint64_t delta_ms)
+{
+    clock_ms += delta_ms;
+}
@@ -1,5 +1,15 @@
-#include <pcap.h>
+#ifdef __linux__
+#define _GNU_SOURCE // sendmmsg
+#endif
 #include "driver.h"
+#if !defined(DRIVER_TPACKET) || !defined(__linux__) //启用TPACKET驱动时由driver_tpacket.c提供驱动
+#include <pcap.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
 
 #ifdef _WIN32
 #include <tchar.h>
@@ -28,9 +38,21 @@ BOOL LoadNpcapDlls()
 }
 #endif
 
-pcap_t *pcap;
 char pcap_errbuf[PCAP_ERRBUF_SIZE];
 
+/**
+ * @brief 每个网卡的驱动状态，保存在net_if_t.driver中
+ *        发送队列中每个数据包聚集成连续的帧后排队，由driver_flush一次发出
+ * 
+ */
+typedef struct driver_if
+{
+    pcap_t *pcap;
+    uint8_t tx_frame[DRIVER_TX_QUEUE_LEN][BUF_BLOCK_LEN];
+    size_t tx_len[DRIVER_TX_QUEUE_LEN];
+    int tx_pending;
+} driver_if_t;
+
 /**
  * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
  * 
@@ -82,7 +104,7 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask)
         ;
     if (max_match == 32)
     {
-        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(net_if_ip));
+        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(ip));
         return -1;
     }
     for (a = d->addresses; a; a = a->next)
@@ -94,11 +116,12 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask)
 }
 
 /**
- * @brief 打开网卡
+ * @brief 打开网卡，按网卡的ip选取所在子网的系统网卡
  * 
+ * @param netif 要打开的网卡
  * @return int 成功为0，失败为-1
  */
-int driver_open()
+int driver_open(net_if_t *netif)
 {
 #ifdef _WIN32
     /* Load Npcap and its functions. */
@@ -111,14 +134,22 @@ int driver_open()
 
     char if_name[PCAP_BUF_SIZE];
     uint32_t mask;
-    if (driver_find(net_if_ip, if_name, (uint8_t *)&mask) < 0)
+    if (driver_find(netif->ip, if_name, (uint8_t *)&mask) < 0)
     {
         fprintf(stderr, "Error in driver find.\n");
         return -1;
     }
-    printf("Using interface %s, my ip is %s.\n", if_name, iptos(net_if_ip));
+    printf("Using interface %s, my ip is %s.\n", if_name, iptos(netif->ip));
 
-    if ((pcap = pcap_open_live(if_name, 65536, 1, 10, pcap_errbuf)) == NULL) //混杂模式打开网卡
+    driver_if_t *drv = calloc(1, sizeof(driver_if_t));
+    if (drv == NULL)
+    {
+        fprintf(stderr, "Error in driver_open: out of memory.\n");
+        return -1;
+    }
+    netif->driver = drv;
+    pcap_t *pcap;
+    if ((drv->pcap = pcap = pcap_open_live(if_name, 65536, 1, 10, pcap_errbuf)) == NULL) //混杂模式打开网卡
     {
         fprintf(stderr, "Error in pcap_open_live.\n%s.\n", pcap_errbuf);
         return -1;
@@ -130,7 +161,7 @@ int driver_open()
     }
     char filter_exp[PCAP_BUF_SIZE];
     struct bpf_program fp;
-    uint8_t mac_addr[6] = NET_IF_MAC;
+    uint8_t *mac_addr = netif->mac;
     sprintf(filter_exp, //过滤数据包
             "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
             mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
@@ -149,12 +180,16 @@ int driver_open()
 }
 /**
  * @brief 试图从网卡接收数据包
+ *        收到的数据包直接指向pcap的帧缓存，不做拷贝，在下一次driver_recv前有效
+ *        上层需要保留数据包时应使用buf_clone或buf_copy取得所有权
  * 
+ * @param netif 网卡
  * @param buf 收到的数据包
  * @return int 数据包的长度，未收到为0，错误为-1
  */
-int driver_recv(buf_t *buf)
+int driver_recv(net_if_t *netif, buf_t *buf)
 {
+    pcap_t *pcap = ((driver_if_t *)netif->driver)->pcap;
     struct pcap_pkthdr *pkt_hdr;
     const uint8_t *pkt_data;
     int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
@@ -162,34 +197,168 @@ int driver_recv(buf_t *buf)
         return 0;
     else if (ret == 1)
     {
-        memcpy(buf->data, pkt_data, pkt_hdr->len);
-        buf->len = pkt_hdr->len;
-        return pkt_hdr->len;
+        buf_free(buf);
+        buf_init_ref(buf, (uint8_t *)pkt_data, pkt_hdr->caplen); //只有caplen字节是有效的
+        buf->if_index = netif->index;
+        return pkt_hdr->caplen;
     }
     fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(pcap));
     return -1;
 }
 /**
- * @brief 使用网卡发送一个数据包
+ * @brief 试图从网卡批量接收至多max个数据包
+ *        这条路径会拷贝：pcap_next_ex返回的帧在下一次读取时就被覆盖(Linux下libpcap每次都写入同一个缓冲区)，
+ *        一批中的帧无法同时引用它，因此每个数据包都拷贝到各自的buffer中
+ *        不拷贝的批量接收只有TPACKET驱动提供，它在下一批开始时才归还环形缓冲区的块
+ * 
+ * @param netif 网卡
+ * @param bufs 收到的数据包
+ * @param max 最多接收的数据包个数
+ * @return int 收到的数据包个数，错误且未收到任何包时为-1
+ */
+int driver_recv_burst(net_if_t *netif, buf_t **bufs, int max)
+{
+    pcap_t *pcap = ((driver_if_t *)netif->driver)->pcap;
+    struct pcap_pkthdr *pkt_hdr;
+    const uint8_t *pkt_data;
+    int n = 0;
+    while (n < max)
+    {
+        int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
+        if (ret == 0)
+            break;
+        if (ret != 1)
+        {
+            fprintf(stderr, "Error in driver_recv_burst.\n%s.\n", pcap_geterr(pcap));
+            return n ? n : -1;
+        }
+        if (buf_init(bufs[n], pkt_hdr->caplen) == -1)
+            continue;
+        memcpy(bufs[n]->data, pkt_data, pkt_hdr->caplen);
+        bufs[n]->if_index = netif->index;
+        n++;
+    }
+    return n;
+}
+/**
+ * @brief 发出一个网卡发送队列中的所有数据包
+ *        Linux下pcap的描述符就是AF_PACKET套接字，用一次sendmmsg发出整个队列
+ * 
+ * @param drv 网卡的驱动状态
+ * @return int 成功为0，失败为-1
+ */
+static int driver_if_flush(driver_if_t *drv)
+{
+    pcap_t *pcap = drv->pcap;
+    int ret = 0;
+#ifdef __linux__
+    struct iovec iov[DRIVER_TX_QUEUE_LEN];
+    struct mmsghdr msgs[DRIVER_TX_QUEUE_LEN] = {0};
+    int fd = pcap_get_selectable_fd(pcap);
+    for (int i = 0; i < drv->tx_pending; i++)
+    {
+        iov[i].iov_base = drv->tx_frame[i];
+        iov[i].iov_len = drv->tx_len[i];
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (int sent = 0, n; sent < drv->tx_pending; sent += n)
+        if ((n = sendmmsg(fd, msgs + sent, drv->tx_pending - sent, 0)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                n = 0;
+                continue;
+            }
+            perror("Error in driver_flush");
+            ret = -1;
+            break;
+        }
+#else
+    for (int i = 0; i < drv->tx_pending; i++)
+        if (pcap_sendpacket(pcap, drv->tx_frame[i], drv->tx_len[i]) == -1)
+        {
+            fprintf(stderr, "Error in driver_flush.\n%s.\n", pcap_geterr(pcap));
+            ret = -1;
+        }
+#endif
+    drv->tx_pending = 0;
+    return ret;
+}
+/**
+ * @brief 把一个数据包放入出口网卡(buf->if_index)的发送队列，队列满时立即发出整个队列
+ *        数据包聚集到队列自己的帧中，返回后调用者可以立即释放或修改数据包
  * 
  * @param buf 要发送的数据包
  * @return int 成功为0，失败为-1
  */
 int driver_send(buf_t *buf)
 {
-    if (pcap_sendpacket(pcap, buf->data, buf->len) == -1)
+    driver_if_t *drv = net_ifs[buf->if_index].driver;
+    size_t len = buf_gather_csum(buf, drv->tx_frame[drv->tx_pending], BUF_BLOCK_LEN);
+    if (len == 0)
     {
-        fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(pcap));
+        fprintf(stderr, "Error in driver_send: frame too long.\n");
         return -1;
     }
-
+    drv->tx_len[drv->tx_pending] = len;
+    if (++drv->tx_pending == DRIVER_TX_QUEUE_LEN)
+        return driver_if_flush(drv);
     return 0;
 }
 /**
- * @brief 关闭网卡
+ * @brief 获取网卡发送队列剩余的位置，在此之内排队的数据包不会触发中途发送
+ * 
+ * @param netif 网卡
+ * @return int 剩余位置数
+ */
+int driver_tx_room(net_if_t *netif)
+{
+    return DRIVER_TX_QUEUE_LEN - ((driver_if_t *)netif->driver)->tx_pending;
+}
+/**
+ * @brief 发出所有网卡发送队列中的数据包
+ * 
+ * @return int 成功为0，任一网卡失败为-1
+ */
+int driver_flush()
+{
+    int ret = 0;
+    for (int i = 0; i < net_if_count; i++)
+        if (net_ifs[i].driver && ((driver_if_t *)net_ifs[i].driver)->tx_pending && driver_if_flush(net_ifs[i].driver) == -1)
+            ret = -1;
+    return ret;
+}
+/**
+ * @brief 获取可以等待网卡数据包到达的描述符
+ * 
+ * @param netif 网卡
+ * @return int 描述符，不支持时为-1
+ */
+int driver_fd(net_if_t *netif)
+{
+#ifdef _WIN32
+    return -1;
+#else
+    return pcap_get_selectable_fd(((driver_if_t *)netif->driver)->pcap);
+#endif
+}
+/**
+ * @brief 关闭所有网卡
  * 
  */
 void driver_close()
 {
-    pcap_close(pcap);
+    driver_flush();
+    for (int i = 0; i < net_if_count; i++)
+    {
+        driver_if_t *drv = net_ifs[i].driver;
+        if (drv == NULL)
+            continue;
+        if (drv->pcap)
+            pcap_close(drv->pcap);
+        free(drv);
+        net_ifs[i].driver = NULL;
+    }
 }
+#endif
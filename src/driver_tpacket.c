@@ -0,0 +1,403 @@
+#include "driver.h"
+#if defined(DRIVER_TPACKET) && defined(__linux__)
+#include <errno.h>
+#include <stdlib.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TPACKET_RX_RING_SIZE ((size_t)DRIVER_TPACKET_BLOCK_SIZE * DRIVER_TPACKET_BLOCK_NR) //接收环形缓冲区大小
+#define TPACKET_TX_RING_SIZE ((size_t)DRIVER_TPACKET_FRAME_SIZE * DRIVER_TX_QUEUE_LEN)   //发送环形缓冲区大小，只有一块
+
+/**
+ * @brief 每个网卡的驱动状态，保存在net_if_t.driver中
+ * 
+ */
+typedef struct tpacket
+{
+    int fd;                      // AF_PACKET套接字
+    uint8_t *ring;               // 内存映射的接收环形缓冲区
+    unsigned block;              // 当前读取的块号
+    struct tpacket3_hdr *frame;  // 当前块中下一个要读取的帧，NULL表示当前块尚未交给用户
+    uint32_t remain;             // 当前块中剩余未读取的帧数
+    unsigned done;               // 已读完但尚未交还内核的块数，即block之前的若干块，这些块中的帧可能仍被上一次收到的数据包引用，到下一次接收时才交还
+    uint8_t *tx_ring;            // 内存映射的发送环形缓冲区，紧接在接收环形缓冲区之后
+    unsigned tx_head;            // 下一个要写入的发送帧号
+    unsigned tx_pending;         // 已写入但还未通知内核发送的帧数
+    uint8_t mac[NET_MAC_LEN];    // 网卡的mac地址，用于过滤
+} tpacket_t;
+
+/**
+ * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
+ * 
+ * @param ip ip地址
+ * @param if_name 出口参数，选取的网卡名
+ * @return int 成功为0，失败为-1
+ */
+static int driver_find(uint8_t *ip, char *if_name)
+{
+    struct ifaddrs *ifaddr, *ifa;
+    uint8_t max_match = 0;
+    if (getifaddrs(&ifaddr) == -1)
+    {
+        perror("Error in getifaddrs");
+        return -1;
+    }
+    for (ifa = ifaddr; ifa; ifa = ifa->ifa_next)
+    {
+        if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET || !ifa->ifa_netmask)
+            continue;
+        uint8_t *addr = (uint8_t *)&((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr;
+        uint8_t *mask = (uint8_t *)&((struct sockaddr_in *)ifa->ifa_netmask)->sin_addr.s_addr;
+        uint8_t match = ip_prefix_match(ip, addr);
+        if (match < ip_prefix_match((uint8_t[]){0xff, 0xff, 0xff, 0xff}, mask) || match <= max_match)
+            continue;
+        if (match == 32)
+        {
+            fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", ifa->ifa_name, iptos(ip));
+            freeifaddrs(ifaddr);
+            return -1;
+        }
+        max_match = match;
+        strncpy(if_name, ifa->ifa_name, IF_NAMESIZE);
+    }
+    freeifaddrs(ifaddr);
+    if (max_match == 0)
+    {
+        fprintf(stderr, "Error, no interface found.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 打开网卡，按网卡的ip选取所在子网的系统网卡，建立TPACKET_V3接收环形缓冲区
+ * 
+ * @param netif 要打开的网卡
+ * @return int 成功为0，失败为-1
+ */
+int driver_open(net_if_t *netif)
+{
+    char if_name[IF_NAMESIZE + 1] = {0};
+    if (driver_find(netif->ip, if_name) < 0)
+    {
+        fprintf(stderr, "Error in driver find.\n");
+        return -1;
+    }
+    printf("Using interface %s (TPACKET_V3), my ip is %s.\n", if_name, iptos(netif->ip));
+
+    tpacket_t *tp = calloc(1, sizeof(tpacket_t));
+    if (tp == NULL)
+    {
+        fprintf(stderr, "Error in driver_open: out of memory.\n");
+        return -1;
+    }
+    if ((tp->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) == -1)
+    {
+        perror("Error in socket(AF_PACKET)");
+        free(tp);
+        return -1;
+    }
+    int version = TPACKET_V3;
+    struct tpacket_req3 req = {
+        .tp_block_size = DRIVER_TPACKET_BLOCK_SIZE,
+        .tp_block_nr = DRIVER_TPACKET_BLOCK_NR,
+        .tp_frame_size = DRIVER_TPACKET_FRAME_SIZE,
+        .tp_frame_nr = DRIVER_TPACKET_BLOCK_SIZE / DRIVER_TPACKET_FRAME_SIZE * DRIVER_TPACKET_BLOCK_NR,
+        .tp_retire_blk_tov = DRIVER_TPACKET_TIMEOUT_MS,
+    };
+    struct tpacket_req3 tx_req = {
+        .tp_block_size = TPACKET_TX_RING_SIZE,
+        .tp_block_nr = 1,
+        .tp_frame_size = DRIVER_TPACKET_FRAME_SIZE,
+        .tp_frame_nr = DRIVER_TX_QUEUE_LEN,
+    };
+    struct sockaddr_ll addr = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_ALL),
+        .sll_ifindex = if_nametoindex(if_name),
+    };
+    struct packet_mreq mreq = {
+        .mr_ifindex = addr.sll_ifindex,
+        .mr_type = PACKET_MR_PROMISC, //混杂模式打开网卡
+    };
+    if (setsockopt(tp->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1 ||
+        setsockopt(tp->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1 ||
+        setsockopt(tp->fd, SOL_PACKET, PACKET_TX_RING, &tx_req, sizeof(tx_req)) == -1 ||
+        setsockopt(tp->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1)
+    {
+        perror("Error in setsockopt(SOL_PACKET)");
+        close(tp->fd);
+        free(tp);
+        return -1;
+    }
+    tp->ring = mmap(NULL, TPACKET_RX_RING_SIZE + TPACKET_TX_RING_SIZE,
+                    PROT_READ | PROT_WRITE, MAP_SHARED, tp->fd, 0);
+    if (tp->ring == MAP_FAILED)
+    {
+        perror("Error in mmap");
+        close(tp->fd);
+        free(tp);
+        return -1;
+    }
+    if (bind(tp->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror("Error in bind");
+        munmap(tp->ring, TPACKET_RX_RING_SIZE + TPACKET_TX_RING_SIZE);
+        close(tp->fd);
+        free(tp);
+        return -1;
+    }
+    tp->tx_ring = tp->ring + TPACKET_RX_RING_SIZE;
+    memcpy(tp->mac, netif->mac, NET_MAC_LEN);
+    netif->driver = tp;
+    return 0;
+}
+
+/**
+ * @brief 内部函数，判断一帧是否应交给协议栈，与pcap驱动的过滤规则一致
+ *        只接收发往本机或广播的帧，丢弃本机发出的帧
+ * 
+ * @param tp 网卡的驱动状态
+ * @param frame 帧头
+ * @return int 接收为1，丢弃为0
+ */
+static int driver_accept(tpacket_t *tp, struct tpacket3_hdr *frame)
+{
+    static const uint8_t broadcast[NET_MAC_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    struct sockaddr_ll *sll = (struct sockaddr_ll *)((uint8_t *)frame + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+    uint8_t *eth = (uint8_t *)frame + frame->tp_mac;
+    if (sll->sll_pkttype == PACKET_OUTGOING || frame->tp_snaplen < 2 * NET_MAC_LEN)
+        return 0;
+    if (memcmp(eth, tp->mac, NET_MAC_LEN) && memcmp(eth, broadcast, NET_MAC_LEN))
+        return 0;
+    return memcmp(eth + NET_MAC_LEN, tp->mac, NET_MAC_LEN) != 0;
+}
+
+/**
+ * @brief 内部函数，把上一次接收时读完的块交还内核
+ * 
+ * @param tp 网卡的驱动状态
+ */
+static void driver_release(tpacket_t *tp)
+{
+    for (; tp->done; tp->done--)
+    {
+        unsigned i = (tp->block + DRIVER_TPACKET_BLOCK_NR - tp->done) % DRIVER_TPACKET_BLOCK_NR;
+        struct tpacket_block_desc *block = (struct tpacket_block_desc *)(tp->ring + (size_t)i * DRIVER_TPACKET_BLOCK_SIZE);
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief 内部函数，取出环形缓冲区中下一个应交给协议栈的帧
+ *        读完的块记入done，不立即交还内核
+ * 
+ * @param tp 网卡的驱动状态
+ * @return struct tpacket3_hdr* 帧头，暂无可读的帧时为NULL
+ */
+static struct tpacket3_hdr *driver_next_frame(tpacket_t *tp)
+{
+    for (;;)
+    {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc *)(tp->ring + (size_t)tp->block * DRIVER_TPACKET_BLOCK_SIZE);
+        if (tp->frame == NULL)
+        {
+            if (tp->done == DRIVER_TPACKET_BLOCK_NR) // 所有块都在等待交还
+                return NULL;
+            if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+                return NULL;
+            tp->remain = block->hdr.bh1.num_pkts;
+            tp->frame = (struct tpacket3_hdr *)((uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+        }
+        if (tp->remain == 0)
+        {
+            tp->done++;
+            tp->block = (tp->block + 1) % DRIVER_TPACKET_BLOCK_NR;
+            tp->frame = NULL;
+            continue;
+        }
+        struct tpacket3_hdr *frame = tp->frame;
+        tp->remain--;
+        tp->frame = (struct tpacket3_hdr *)((uint8_t *)frame + frame->tp_next_offset);
+        if (driver_accept(tp, frame))
+            return frame;
+    }
+}
+
+/**
+ * @brief 内部函数，让数据包直接指向环形缓冲区中的帧，不做拷贝
+ *        帧头与帧之间的空隙作为数据包的头部空间
+ * 
+ * @param netif 网卡
+ * @param buf 数据包
+ * @param frame 帧头
+ * @return int 数据包的长度
+ */
+static int driver_wrap(net_if_t *netif, buf_t *buf, struct tpacket3_hdr *frame)
+{
+    uint8_t *start = (uint8_t *)frame + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) + sizeof(struct sockaddr_ll);
+    buf_free(buf);
+    buf_init_ref(buf, (uint8_t *)frame + frame->tp_mac, frame->tp_snaplen);
+    buf->payload = start;
+    buf->size = (uint8_t *)frame + frame->tp_mac + frame->tp_snaplen - start;
+    buf->if_index = netif->index;
+    // 内核已校验过的，或本机发出、校验和尚未填写的帧，上层不再校验TCP/UDP校验和
+    if (frame->tp_status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY))
+        buf->csum_flags |= BUF_CSUM_L4_VALID;
+    return frame->tp_snaplen;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ *        依次读取内核交给用户的块中的每一帧，块读完后在下一次接收时整块交还内核
+ *        收到的数据包直接指向环形缓冲区中的帧，不做拷贝，在下一次driver_recv前有效
+ * 
+ * @param netif 网卡
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+int driver_recv(net_if_t *netif, buf_t *buf)
+{
+    tpacket_t *tp = netif->driver;
+    driver_release(tp);
+    struct tpacket3_hdr *frame = driver_next_frame(tp);
+    return frame ? driver_wrap(netif, buf, frame) : 0;
+}
+
+/**
+ * @brief 试图从网卡批量接收至多max个数据包
+ *        与driver_recv相同，数据包直接指向环形缓冲区中的帧，在下一次接收前全部有效
+ * 
+ * @param netif 网卡
+ * @param bufs 收到的数据包
+ * @param max 最多接收的数据包个数
+ * @return int 收到的数据包个数
+ */
+int driver_recv_burst(net_if_t *netif, buf_t **bufs, int max)
+{
+    tpacket_t *tp = netif->driver;
+    driver_release(tp);
+    int n = 0;
+    struct tpacket3_hdr *frame;
+    while (n < max && (frame = driver_next_frame(tp)))
+        driver_wrap(netif, bufs[n++], frame);
+    return n;
+}
+
+/**
+ * @brief 内部函数，通知内核发送一个网卡发送环形缓冲区中所有待发送的帧，一次系统调用发出整个队列
+ *        阻塞到这些帧发送完成，之后它们所在的帧可以重新写入
+ * 
+ * @param tp 网卡的驱动状态
+ * @return int 成功为0，失败为-1
+ */
+static int driver_if_flush(tpacket_t *tp)
+{
+    if (tp->tx_pending == 0)
+        return 0;
+    while (send(tp->fd, NULL, 0, 0) == -1)
+    {
+        if (errno == EINTR)
+            continue;
+        perror("Error in driver_flush");
+        return -1;
+    }
+    tp->tx_pending = 0;
+    return 0;
+}
+
+/**
+ * @brief 把一个数据包写入出口网卡(buf->if_index)发送环形缓冲区的下一帧，写满一圈时立即通知内核发送
+ *        分散/聚集链的各段直接聚集到环形缓冲区中，返回后调用者可以立即释放或修改数据包
+ * 
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf)
+{
+    tpacket_t *tp = net_ifs[buf->if_index].driver;
+    struct tpacket3_hdr *frame = (struct tpacket3_hdr *)(tp->tx_ring + (size_t)tp->tx_head * DRIVER_TPACKET_FRAME_SIZE);
+    if (__atomic_load_n(&frame->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE &&
+        (driver_if_flush(tp) == -1 || __atomic_load_n(&frame->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE))
+    {
+        fprintf(stderr, "Error in driver_send: tx ring busy.\n");
+        return -1;
+    }
+    size_t len = buf_gather_csum(buf, (uint8_t *)frame + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)),
+                            DRIVER_TPACKET_FRAME_SIZE - TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+    if (len == 0)
+    {
+        fprintf(stderr, "Error in driver_send: frame too long.\n");
+        return -1;
+    }
+    frame->tp_len = len;
+    frame->tp_next_offset = 0;
+    __atomic_store_n(&frame->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    tp->tx_head = (tp->tx_head + 1) % DRIVER_TX_QUEUE_LEN;
+    if (++tp->tx_pending == DRIVER_TX_QUEUE_LEN)
+        return driver_if_flush(tp);
+    return 0;
+}
+
+/**
+ * @brief 获取网卡发送环形缓冲区中还能写入的帧数，在此之内写入的帧不会触发中途发送
+ * 
+ * @param netif 网卡
+ * @return int 剩余帧数
+ */
+int driver_tx_room(net_if_t *netif)
+{
+    return DRIVER_TX_QUEUE_LEN - ((tpacket_t *)netif->driver)->tx_pending;
+}
+
+/**
+ * @brief 通知内核发送所有网卡发送环形缓冲区中待发送的帧
+ * 
+ * @return int 成功为0，任一网卡失败为-1
+ */
+int driver_flush()
+{
+    int ret = 0;
+    for (int i = 0; i < net_if_count; i++)
+        if (net_ifs[i].driver && driver_if_flush(net_ifs[i].driver) == -1)
+            ret = -1;
+    return ret;
+}
+
+/**
+ * @brief 获取可以等待网卡数据包到达的描述符，环形缓冲区中有块交给用户时可读
+ * 
+ * @param netif 网卡
+ * @return int 描述符
+ */
+int driver_fd(net_if_t *netif)
+{
+    return ((tpacket_t *)netif->driver)->fd;
+}
+
+/**
+ * @brief 关闭所有网卡
+ * 
+ */
+void driver_close()
+{
+    driver_flush();
+    for (int i = 0; i < net_if_count; i++)
+    {
+        tpacket_t *tp = net_ifs[i].driver;
+        if (tp == NULL)
+            continue;
+        munmap(tp->ring, TPACKET_RX_RING_SIZE + TPACKET_TX_RING_SIZE);
+        close(tp->fd);
+        free(tp);
+        net_ifs[i].driver = NULL;
+    }
+}
+#endif
\ No newline at end of file
@@ -5,32 +5,77 @@
 #include "ip.h"
 
 /**
- * @brief 处理一个收到的数据包
+ * @brief 内部函数，检查并去掉以太网头
  * 
- * @param buf 要处理的数据包
+ * @param buf 收到的数据包
+ * @param proto 出口参数，上层协议号
+ * @param mac 出口参数，源mac地址
+ * @return int 应交给上层为0，否则为-1
  */
-void ethernet_in(buf_t *buf)
+static int ethernet_strip(buf_t *buf, uint16_t *proto, uint8_t *mac)
 {
-    // TO-DO
     if (buf->len < sizeof(ether_hdr_t)) {
         printf("buffer too short\n");
-        return;
+        return -1;
     }
     ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
-    uint16_t proto = swap16(hdr->protocol16);
-    uint8_t mac[NET_MAC_LEN];
+    *proto = swap16(hdr->protocol16);
     memmove(mac, hdr->src, NET_MAC_LEN);
+    // 驱动只接收发往网卡mac或广播地址的帧，目的mac不是网卡自己的就是以链路层广播(或组播)收到的
+    buf->l2_bcast = memcmp(hdr->dst, net_ifs[buf->if_index].mac, NET_MAC_LEN) != 0;
     if (buf_remove_header(buf, sizeof(ether_hdr_t)) == -1) {
         printf("failed to remove header");
-        return;
+        return -1;
     }
+    return 0;
+}
+
+/**
+ * @brief 处理一个收到的数据包
+ * 
+ * @param buf 要处理的数据包
+ */
+void ethernet_in(buf_t *buf)
+{
+    // TO-DO
+    uint16_t proto;
+    uint8_t mac[NET_MAC_LEN];
+    if (ethernet_strip(buf, &proto, mac) == -1)
+        return;
     if (net_in(buf, proto, mac) == -1) {
         // printf("failed to give upper buffer");
         return;
     }
 }
+
+/**
+ * @brief 批量处理一组收到的数据包
+ *        先对整组去掉以太网头，再把留下的数据包按上层协议成组交给上层
+ * 
+ * @param bufs 要处理的数据包，最多NET_BURST_SIZE个
+ * @param n 数据包个数
+ */
+void ethernet_in_burst(buf_t **bufs, int n)
+{
+    buf_t *vec[NET_BURST_SIZE];
+    uint8_t macs[NET_BURST_SIZE][NET_MAC_LEN];
+    uint8_t *srcs[NET_BURST_SIZE];
+    uint16_t protos[NET_BURST_SIZE];
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (i + 1 < n)
+            __builtin_prefetch(bufs[i + 1]->data); // 处理当前包时预取下一个包的头部
+        if (ethernet_strip(bufs[i], &protos[m], macs[m]) == -1)
+            continue;
+        vec[m] = bufs[i];
+        srcs[m] = macs[m];
+        m++;
+    }
+    net_in_vector(vec, srcs, protos, m, NULL);
+}
+
 /**
- * @brief 处理一个要发送的数据包
+ * @brief 处理一个要发送的数据包，从buf->if_index指明的网卡发出
  * 
  * @param buf 要处理的数据包
  * @param mac 目标MAC地址
@@ -39,8 +84,10 @@ void ethernet_in(buf_t *buf)
 void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
 {
     // TO-DO
-    if (buf->len < 46) {
-        if (buf_add_padding(buf, 46 - buf->len) == -1) {
+    size_t len = buf_chain_len(buf);
+    if (len < 46) {
+        // 分散/聚集链或直接指向网卡帧的包没有尾部空间，先合并到独占的数据块中
+        if (buf_linearize(buf) == -1 || buf_add_padding(buf, 46 - len) == -1) {
             printf("failed to add pad\n");
             return ;
         }
@@ -49,30 +96,63 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
         printf("failed to add header\n");
         return;
     }
+    net_if_t *netif = &net_ifs[buf->if_index];
     ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
     memmove(hdr->dst, mac, NET_MAC_LEN);
-    memmove(hdr->src, net_if_mac, NET_MAC_LEN);
+    memmove(hdr->src, netif->mac, NET_MAC_LEN);
     hdr->protocol16 = swap16(protocol);
     if (driver_send(buf) == -1) {
+        netif->stats.tx_errors++;
         printf("failed to send buffer\n");
         return;
     }
+    netif->stats.tx_packets++;
+    netif->stats.tx_bytes += (len < 46 ? 46 : len) + sizeof(ether_hdr_t);
 }
+/**
+ * @brief 批量接收的数据包描述符，由驱动直接指向网卡帧
+ * 
+ */
+static buf_t rx_bufs[NET_BURST_SIZE];
+static buf_t *rx_vec[NET_BURST_SIZE];
+
 /**
  * @brief 初始化以太网协议
  * 
  */
 void ethernet_init()
 {
-    buf_init(&rxbuf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+    for (int i = 0; i < NET_BURST_SIZE; i++)
+        rx_vec[i] = &rx_bufs[i];
 }
 
 /**
- * @brief 一次以太网轮询
+ * @brief 下一次轮询最先服务的网卡
  * 
  */
-void ethernet_poll()
+static int poll_next;
+
+/**
+ * @brief 一次以太网轮询，每个网卡至多接收一批数据包
+ *        起始网卡每次轮换，繁忙的网卡不会总是抢在其他网卡之前
+ *        批量接收是否拷贝取决于驱动：pcap驱动逐帧拷贝，TPACKET驱动直接引用环形缓冲区
+ * 
+ * @return int 收到的数据包个数
+ */
+int ethernet_poll()
 {
-    if (driver_recv(&rxbuf) > 0)
-        ethernet_in(&rxbuf);
+    int total = 0;
+    for (int k = 0; k < net_if_count; k++) {
+        net_if_t *netif = &net_ifs[(poll_next + k) % net_if_count];
+        int n = driver_recv_burst(netif, rx_vec, NET_BURST_SIZE);
+        if (n <= 0)
+            continue;
+        netif->stats.rx_packets += n;
+        for (int i = 0; i < n; i++)
+            netif->stats.rx_bytes += rx_vec[i]->len;
+        ethernet_in_burst(rx_vec, n);
+        total += n;
+    }
+    poll_next = (poll_next + 1) % net_if_count;
+    return total;
 }
@@ -1,26 +1,36 @@
 #include "net.h"
 #include "icmp.h"
 #include "ip.h"
+#include "checksum.h"
+#include "clock.h"
+
+/**
+ * @brief 差错报文的令牌桶，以千分之一个报文为单位，每毫秒补充ICMP_ERROR_RATE，最多积攒ICMP_ERROR_BURST个报文
+ * 
+ */
+static uint64_t icmp_error_tokens;
+static uint64_t icmp_error_last_ms;
 
 /**
  * @brief 发送icmp响应
  * 
- * @param req_buf 收到的icmp请求包
+ * @param req_buf 收到的icmp请求包，可以是重组的分片链
  * @param src_ip 源ip地址
  */
 static void icmp_resp(buf_t *req_buf, uint8_t *src_ip)
 {
     // TO-DO
-    buf_init(&txbuf, req_buf->len);
+    size_t len = buf_chain_len(req_buf);
+    buf_init(&txbuf, len);
     icmp_hdr_t *ich = (icmp_hdr_t *)txbuf.data;
-    icmp_hdr_t *src_ich = (icmp_hdr_t *)req_buf->data;
+    buf_gather(req_buf, txbuf.data, len); // 应答本来就要拷贝一次，分片链在这里直接聚集
+    // 回显应答只改写type与code所在的一个字，由请求的校验和增量得到应答的校验和
+    uint16_t old_word, new_word;
+    memcpy(&old_word, &ich->type, sizeof(old_word));
     ich->type = ICMP_TYPE_ECHO_REPLY;
     ich->code = ICMP_TYPE_ECHO_REPLY;
-    ich->checksum16 = 0;
-    ich->id16 = src_ich->id16;
-    ich->seq16 = src_ich->seq16;
-    memmove(txbuf.data + sizeof(icmp_hdr_t), req_buf->data + sizeof(icmp_hdr_t), req_buf->len - sizeof(icmp_hdr_t));
-    ich->checksum16 = checksum16((uint16_t *)ich, req_buf->len);
+    memcpy(&new_word, &ich->type, sizeof(new_word));
+    ich->checksum16 = checksum_adjust16(ich->checksum16, old_word, new_word);
     ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
     return;
 }
@@ -34,40 +44,133 @@ static void icmp_resp(buf_t *req_buf, uint8_t *src_ip)
 void icmp_in(buf_t *buf, uint8_t *src_ip)
 {
     // TO-DO
+    // 重组的数据报是分片链，第一个分片的负载至少8字节，icmp头总在第一段内
     if (buf->len < sizeof(icmp_hdr_t)) {
         printf("buffer too short\n");
         return;
     }
     icmp_hdr_t* ich = (icmp_hdr_t *)buf->data;
+    if (buf_checksum16(buf)) { // 连同校验和字段一起求和，正确时结果为0
+        printf("icmp_in checksum failed\n");
+        return;
+    }
     if (ich->type == ICMP_TYPE_ECHO_REQUEST)
         icmp_resp(buf, src_ip);
+    // 需要分片：seq字段是下一跳MTU(RFC 1191)，其后是引发差错的原数据报首部
+    else if (ich->type == ICMP_TYPE_UNREACH && ich->code == ICMP_CODE_FRAG_NEEDED && buf->len >= sizeof(icmp_hdr_t) + sizeof(ip_hdr_t))
+        ip_pmtu_update((ip_hdr_t *)(ich + 1), swap16(ich->seq16));
     return;
     
 }
 
 /**
- * @brief 发送icmp不可达
+ * @brief 内部函数，判断收到的数据包是否不能引发icmp差错报文(RFC 1122 3.2.2, RFC 1812 4.3.2.7)
+ *        icmp差错报文、非首个分片、以链路层广播收到或发往组播与广播地址的包，
+ *        以及源地址不能标识单个主机(0、环回、组播、广播)的包都不回复
  * 
  * @param recv_buf 收到的ip数据包
  * @param src_ip 源ip地址
- * @param code icmp code，协议不可达或端口不可达
+ * @return int 不能回复为1，否则为0
  */
-void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+static int icmp_error_suppressed(buf_t *recv_buf, uint8_t *src_ip)
 {
-    // TO-DO
-    buf_init(&txbuf, sizeof(icmp_code_t) + sizeof(ip_hdr_t) + 12);
+    ip_hdr_t *iph = (ip_hdr_t *)recv_buf->data;
+    if (recv_buf->len < sizeof(ip_hdr_t) || recv_buf->l2_bcast || iph->dst_ip[0] >= 224)
+        return 1;
+    if (src_ip[0] == 0 || src_ip[0] == 127 || src_ip[0] >= 224 || ip_directed_bcast(src_ip))
+        return 1;
+    if (swap16(iph->flags_fragment16) & IP_FRAG_OFFSET_MASK)
+        return 1;
+    if (iph->protocol != NET_PROTOCOL_ICMP)
+        return 0;
+    size_t hdr_len = iph->hdr_len * IP_HDR_LEN_PER_BYTE;
+    if (recv_buf->len <= hdr_len)
+        return 1; // 看不到类型的icmp报文按差错报文处理
+    uint8_t type = recv_buf->data[hdr_len];
+    return type == ICMP_TYPE_UNREACH || type == ICMP_TYPE_SOURCE_QUENCH || type == ICMP_TYPE_REDIRECT ||
+           type == ICMP_TYPE_TIME_EXCEEDED || type == ICMP_TYPE_PARAM_PROBLEM;
+}
+
+/**
+ * @brief 内部函数，从令牌桶中取一个令牌，限制差错报文的发送速率
+ * 
+ * @return int 取到为1，令牌耗尽为0
+ */
+static int icmp_error_take()
+{
+    uint64_t now = clock_now_ms();
+    icmp_error_tokens += (now - icmp_error_last_ms) * ICMP_ERROR_RATE;
+    icmp_error_last_ms = now;
+    if (icmp_error_tokens > ICMP_ERROR_BURST * 1000)
+        icmp_error_tokens = ICMP_ERROR_BURST * 1000;
+    if (icmp_error_tokens < 1000)
+        return 0;
+    icmp_error_tokens -= 1000;
+    return 1;
+}
+
+/**
+ * @brief 内部函数，发送引用收到的ip数据包首部的icmp差错报文
+ *        引用原数据报的ip头与其后8字节，原数据报更短时只引用实际的长度
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param type icmp type
+ * @param code icmp code
+ * @param mtu 需要分片时的下一跳MTU，其他差错为0
+ */
+static void icmp_error(buf_t *recv_buf, uint8_t *src_ip, icmp_type_t type, uint8_t code, uint16_t mtu)
+{
+    if (icmp_error_suppressed(recv_buf, src_ip) || !icmp_error_take())
+        return;
+    ip_hdr_t *iph = (ip_hdr_t *)recv_buf->data;
+    size_t len = min32(recv_buf->len, iph->hdr_len * IP_HDR_LEN_PER_BYTE + 8);
+    buf_init(&txbuf, sizeof(icmp_hdr_t) + len);
     icmp_hdr_t *ich = (icmp_hdr_t *)txbuf.data;
-    // ip_hdr_t *ih = (ip_hdr_t *)recv_buf->data;
     ich->checksum16 = 0;
-    ich->type = ICMP_TYPE_UNREACH;
+    ich->type = type;
     ich->code = code;
     ich->id16 = 0;
-    ich->seq16 = 0;
-    // txbuf.data += 2;
-    memmove(txbuf.data + sizeof(icmp_code_t) + 4, recv_buf->data, sizeof(ip_hdr_t) + 8);
-    ich->checksum16 = checksum16((uint16_t *)ich, sizeof(icmp_code_t) + sizeof(ip_hdr_t) + 12);
+    ich->seq16 = swap16(mtu);
+    memcpy(ich + 1, recv_buf->data, len);
+    ich->checksum16 = checksum16((uint16_t *)ich, sizeof(icmp_hdr_t) + len);
     ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
-    return;
+}
+
+/**
+ * @brief 发送icmp不可达
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param code icmp code，网络不可达、协议不可达或端口不可达
+ */
+void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
+{
+    // TO-DO
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_UNREACH, code, 0);
+}
+
+/**
+ * @brief 转发时TTL耗尽，发送icmp超时
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ */
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_TIME_EXCEEDED, 0, 0);
+}
+
+/**
+ * @brief 转发时设置了DF的数据包超过出口网卡的MTU，发送icmp需要分片
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param mtu 出口网卡的MTU
+ */
+void icmp_frag_needed(buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_UNREACH, ICMP_CODE_FRAG_NEEDED, mtu);
 }
 
 /**
@@ -75,5 +178,7 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
  * 
  */
 void icmp_init(){
+    icmp_error_tokens = ICMP_ERROR_BURST * 1000;
+    icmp_error_last_ms = clock_now_ms();
     net_add_protocol(NET_PROTOCOL_ICMP, icmp_in);
 }
\ No newline at end of file
@@ -3,21 +3,90 @@
 #include "ethernet.h"
 #include "arp.h"
 #include "icmp.h"
+#include "driver.h"
+#include "route.h"
+#include "checksum.h"
 
 static size_t id = -1;
+
 /**
- * @brief 处理一个收到的数据包
+ * @brief 正在重组的数据报，<ip_reass_key_t,ip_reass_t>的容器，条目从收到第一个分片起IP_REASS_TIMEOUT_SEC后超时
  * 
- * @param buf 要处理的数据包
- * @param src_mac 源mac地址
  */
-void ip_in(buf_t *buf, uint8_t *src_mac)
+map_t ip_reass_table;
+
+/**
+ * @brief 重组中的分片占用的数据块总大小
+ * 
+ */
+size_t ip_reass_mem;
+
+/**
+ * @brief 为1时转发目的地址不是本机的数据包
+ * 
+ */
+int ip_forwarding = IP_FORWARD;
+
+/**
+ * @brief 转发路径的统计计数
+ * 
+ */
+ip_stats_t ip_stats;
+
+/**
+ * @brief 重组完成的数据报的分片，链接成分散/聚集链交给上层，之后释放
+ * 
+ */
+static buf_t ip_reass_done[IP_REASS_MAX_FRAGS];
+
+/**
+ * @brief 路径MTU缓存，<目的ip,uint16_t>的容器，只记录比出口网卡MTU小的路径，IP_PMTU_TIMEOUT_SEC后老化
+ * 
+ */
+map_t ip_pmtu_table;
+
+/**
+ * @brief RFC 1191中的常见MTU，路由器没有给出下一跳MTU时按原数据报长度取下一个更小的值
+ * 
+ */
+static const uint16_t ip_pmtu_plateaus[] = {32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, 68};
+
+/**
+ * @brief 判断地址是否是某个网卡所在子网的广播地址
+ * 
+ * @param ip ip地址
+ * @return int 是为1，否则为0
+ */
+int ip_directed_bcast(const uint8_t *ip)
+{
+    uint32_t addr = (uint32_t)ip[0] << 24 | ip[1] << 16 | ip[2] << 8 | ip[3];
+    for (int i = 0; i < net_if_count; i++) {
+        net_if_t *netif = &net_ifs[i];
+        if (netif->prefix_len == 0 || netif->prefix_len >= 31)
+            continue; // /31与/32没有广播地址
+        uint32_t mask = UINT32_MAX << (32 - netif->prefix_len);
+        uint32_t own = (uint32_t)netif->ip[0] << 24 | netif->ip[1] << 16 | netif->ip[2] << 8 | netif->ip[3];
+        if ((addr & mask) == (own & mask) && (addr | mask) == UINT32_MAX)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 内部函数，检查ip头并去掉ip头与填充
+ * 
+ * @param buf 收到的数据包
+ * @param protocol 出口参数，上层协议号
+ * @param src_ip 出口参数，源ip地址
+ * @return int 应交给上层为0，是分片为1，应转发为2，否则为-1
+ *         只接收发往收到该包的网卡地址的包(强主机模型)，发往本机其他网卡地址的包丢弃而不转发
+ */
+static int ip_strip(buf_t *buf, uint8_t *protocol, uint8_t *src_ip)
 {
-    // TO-DO
     // check buf len
     if (buf->len < sizeof(ip_hdr_t)) {
         printf("buffer too short\n");
-        return;
+        return -1;
     }
     // check head
     ip_hdr_t *iph = (ip_hdr_t *)buf->data;
@@ -25,50 +94,379 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
     uint16_t len = swap16(iph->total_len16);
     if (version != IP_VERSION_4 || buf->len < len) {
         printf("invalid pkg header, abort\n");
-        return;
+        return -1;
     }
-    uint16_t origin_check = iph->hdr_checksum16;
-    iph->hdr_checksum16 = 0;
-    uint16_t res = checksum16((uint16_t *)iph, sizeof(ip_hdr_t));
-    if (res != origin_check) {
+    // 连同校验和字段一起求和，正确时结果为0，不需要改写首部；驱动已确认过的不再计算
+    if (!(buf->csum_flags & BUF_CSUM_IP_VALID) && checksum16((uint16_t *)iph, sizeof(ip_hdr_t))) {
         printf("ip_in checksum failed\n");
-        return;
+        return -1;
     }
-    iph->hdr_checksum16 = origin_check;
 
-    uint8_t src_ip[NET_IP_LEN];
     memmove(src_ip, iph->src_ip, NET_IP_LEN);
-    
-    
-    if (memcmp(iph->dst_ip, net_if_ip, NET_IP_LEN)) {
-        // icmp_unreachable(buf, src_ip, ICMP_CODE_PROTOCOL_UNREACH);
-        return;
-    }
 
     if (buf->len > len)
         buf_remove_padding(buf, buf->len - len);
 
-    uint8_t protocal = iph->protocol;
+    if (memcmp(iph->dst_ip, net_ifs[buf->if_index].ip, NET_IP_LEN)) {
+        // 广播与组播不转发，包括以链路层广播收到的包和发往直连子网广播地址的包(RFC 1812 5.3.4, 5.3.5)
+        if (ip_forwarding && iph->dst_ip[0] < 224 && !buf->l2_bcast && len >= sizeof(ip_hdr_t) && !net_if_find(iph->dst_ip) && !ip_directed_bcast(iph->dst_ip))
+            return 2;
+        // icmp_unreachable(buf, src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+        return -1;
+    }
+
+    *protocol = iph->protocol;
     buf_remove_header(buf, sizeof(ip_hdr_t));
-    
-    if (net_in(buf, protocal, src_ip) == -1) {
-        buf_add_header(buf, sizeof(ip_hdr_t));
-        memmove(buf->data, iph, sizeof(ip_hdr_t));
-        icmp_unreachable(buf, src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+    return swap16(iph->flags_fragment16) & (IP_MORE_FRAGMENT | IP_FRAG_OFFSET_MASK) ? 1 : 0;
+}
+
+/**
+ * @brief 内部函数，上层协议不可达时恢复ip头并回复icmp协议不可达
+ * 
+ * @param buf 已去掉ip头的数据包
+ * @param src_ip 源ip地址
+ */
+static void ip_unreachable(buf_t *buf, uint8_t *src_ip)
+{
+    buf_add_header(buf, sizeof(ip_hdr_t)); // ip头仍在头部空间中，原样恢复
+    icmp_unreachable(buf, src_ip, ICMP_CODE_PROTOCOL_UNREACH);
+}
+
+/**
+ * @brief 释放重组中的数据报持有的分片，作为ip_reass_table的值析构函数
+ * 
+ * @param value 重组中的数据报
+ */
+static void ip_reass_free(void *value)
+{
+    ip_reass_t *reass = value;
+    for (int i = 0; i < reass->count; i++)
+        buf_free(&reass->frags[i]);
+    ip_reass_mem -= reass->mem;
+    reass->count = 0;
+    reass->mem = 0;
+}
+
+/**
+ * @brief 内部函数，把一个分片按偏移插入数据报，与已有分片重叠的部分被裁掉
+ *        分片连同头部空间中的ip头一起共享或拷贝，不拷贝到一个大缓冲区中
+ * 
+ * @param reass 重组中的数据报
+ * @param buf 已去掉ip头的分片
+ * @param offset 分片负载在数据报中的偏移
+ * @return int 插入为0，与已有分片完全重叠或分片过多而丢弃为-1
+ */
+static int ip_reass_insert(ip_reass_t *reass, buf_t *buf, uint32_t offset)
+{
+    uint32_t start = offset, end = offset + buf->len;
+    int pos = 0;
+    while (pos < reass->count && reass->offsets[pos] < offset)
+        pos++;
+    if (pos > 0) {
+        uint32_t prev_end = reass->offsets[pos - 1] + reass->frags[pos - 1].len;
+        if (prev_end > start)
+            start = prev_end;
     }
+    if (pos < reass->count && reass->offsets[pos] < end) {
+        // 覆盖后一个分片起点时只保留它之前的部分，完全覆盖后一个分片的不处理
+        if (reass->offsets[pos] <= start || reass->offsets[pos] + reass->frags[pos].len < end)
+            return -1;
+        end = reass->offsets[pos];
+    }
+    if (start >= end || reass->count == IP_REASS_MAX_FRAGS)
+        return -1;
+
+    buf_t *frag = &reass->frags[pos];
+    memmove(frag + 1, frag, (reass->count - pos) * sizeof(buf_t));
+    memmove(&reass->offsets[pos + 1], &reass->offsets[pos], (reass->count - pos) * sizeof(uint16_t));
+    buf_add_header(buf, sizeof(ip_hdr_t));
+    buf_clone(frag, buf, 0);
+    buf_remove_header(buf, sizeof(ip_hdr_t));
+    if (frag->payload == NULL) {
+        memmove(frag, frag + 1, (reass->count - pos) * sizeof(buf_t));
+        memmove(&reass->offsets[pos], &reass->offsets[pos + 1], (reass->count - pos) * sizeof(uint16_t));
+        return -1;
+    }
+    buf_remove_header(frag, sizeof(ip_hdr_t) + start - offset);
+    frag->len = end - start;
+    reass->offsets[pos] = start;
+    reass->count++;
+    reass->received += end - start;
+    reass->mem += frag->size;
+    ip_reass_mem += frag->size;
+    return 0;
 }
 
 /**
- * @brief 处理一个要发送的ip分片
+ * @brief 内部函数，把重组完成的数据报的分片链接成链交给上层，之后释放
+ * 
+ * @param reass 重组完成的数据报，分片转交后被清空
+ * @param key 数据报的键
+ */
+static void ip_reass_deliver(ip_reass_t *reass, ip_reass_key_t *key)
+{
+    int n = reass->count;
+    memcpy(ip_reass_done, reass->frags, n * sizeof(buf_t));
+    ip_reass_mem -= reass->mem;
+    reass->count = 0;
+    reass->mem = 0;
+    map_delete(&ip_reass_table, key);
+
+    for (int i = 0; i + 1 < n; i++)
+        ip_reass_done[i].next = &ip_reass_done[i + 1];
+    buf_t *head = &ip_reass_done[0];
+    head->csum_flags = 0; // 驱动对单个分片的校验结论不适用于整个数据报
+    if (net_in(head, key->protocol, key->src_ip) == -1)
+        ip_unreachable(head, key->src_ip);
+    for (int i = 0; i < n; i++)
+        buf_free(&ip_reass_done[i]);
+}
+
+/**
+ * @brief 内部函数，处理一个收到的分片，数据报完整时交给上层
+ *        重组中的分片占用超过IP_REASS_MAX_BYTES时从最早的数据报开始淘汰
+ * 
+ * @param buf 已去掉ip头的分片，ip头仍在头部空间中
+ * @param protocol 上层协议号
+ * @param src_ip 源ip地址
+ */
+static void ip_reass_in(buf_t *buf, uint8_t protocol, uint8_t *src_ip)
+{
+    ip_hdr_t *iph = (ip_hdr_t *)(buf->data - sizeof(ip_hdr_t));
+    uint16_t fragment = swap16(iph->flags_fragment16);
+    uint32_t offset = (fragment & IP_FRAG_OFFSET_MASK) * IP_HDR_OFFSET_PER_BYTE;
+    int more = (fragment & IP_MORE_FRAGMENT) != 0;
+    if (offset + buf->len > UINT16_MAX - sizeof(ip_hdr_t) || (more && (buf->len == 0 || buf->len % IP_HDR_OFFSET_PER_BYTE))) {
+        printf("invalid fragment, abort\n");
+        return;
+    }
+
+    ip_reass_key_t key = {.protocol = protocol, .id16 = iph->id16};
+    memcpy(key.src_ip, src_ip, NET_IP_LEN);
+    memcpy(key.dst_ip, iph->dst_ip, NET_IP_LEN);
+    ip_reass_t *reass = map_get(&ip_reass_table, &key);
+    if (reass == NULL) {
+        static const ip_reass_t empty;
+        if (map_set(&ip_reass_table, &key, &empty) == -1)
+            return;
+        reass = map_get(&ip_reass_table, &key);
+    }
+
+    uint32_t end = offset + buf->len;
+    if (!more) {
+        // 最后一个分片确定总长度，与已有分片矛盾时丢弃整个数据报
+        uint32_t max_end = reass->count ? reass->offsets[reass->count - 1] + reass->frags[reass->count - 1].len : 0;
+        if ((reass->last && reass->total != end) || max_end > end) {
+            map_delete(&ip_reass_table, &key);
+            return;
+        }
+        reass->last = 1;
+        reass->total = end;
+    } else if (reass->last && end > reass->total) {
+        return;
+    }
+    if (ip_reass_insert(reass, buf, offset) == -1)
+        return;
+
+    while (ip_reass_mem > IP_REASS_MAX_BYTES) {
+        ip_reass_key_t oldest = *(ip_reass_key_t *)map_oldest(&ip_reass_table);
+        map_delete(&ip_reass_table, &oldest);
+        if (!memcmp(&oldest, &key, sizeof(key)))
+            return;
+    }
+    reass = map_get(&ip_reass_table, &key); // 淘汰可能移动了条目
+    if (reass->last && reass->received == reass->total)
+        ip_reass_deliver(reass, &key);
+}
+
+/**
+ * @brief 内部函数，把一个数据报的负载按出口MTU分片，所有分片作为一批从出口网卡发出
+ *        每个分片只新建一个放IP头的头部段，负载段直接引用原数据，不做拷贝
+ *        分片的ip头由hdr复制，保留id、TTL、源地址等字段；偏移在hdr原有偏移上累加，
+ *        hdr设置了MF(转发的本身就是分片)时最后一个分片也设置MF
+ * 
+ * @param buf 不含ip头的负载，可以是分散/聚集链
+ * @param hdr 分片ip头的模板
+ * @param max_data 每个分片的最大负载长度，必须被8整除
+ * @param netif 出口网卡
+ * @param via 下一跳地址
+ * @param nh 下一跳缓存，为NULL时对整个数据报只查一次arp表
+ */
+static void ip_fragment_chain(buf_t *buf, const ip_hdr_t *hdr, size_t max_data, net_if_t *netif, uint8_t *via, arp_cache_t *nh)
+{
+    size_t len = buf_chain_len(buf);
+    // 分片后校验范围跨越多个帧，留待发送时补全的校验和必须先在软件中算好
+    if (buf_csum_resolve(buf) == -1) {
+        printf("failed to resolve checksum before fragmenting\n");
+        return;
+    }
+    // 所有分片作为一批发出：队列剩余位置放不下时先清空，避免一个数据报被拆到两次发送中
+    int frags = (len + max_data - 1) / max_data;
+    if (frags <= DRIVER_TX_QUEUE_LEN && driver_tx_room(netif) < frags)
+        driver_flush();
+    // 下一跳对整个数据报只查一次表，后续分片直接使用缓存的mac
+    arp_cache_t local = {0};
+    if (nh == NULL)
+        nh = &local;
+    uint16_t fragment = swap16(hdr->flags_fragment16);
+    uint16_t base = fragment & IP_FRAG_OFFSET_MASK;
+    uint16_t flags = fragment & ~(IP_FRAG_OFFSET_MASK | IP_MORE_FRAGMENT);
+    buf_t head = {0};
+    buf_t segs[IP_FRAG_MAX_SEGS];
+    for (size_t offset = 0; offset < len; offset += max_data) {
+        size_t size = min32(len - offset, max_data);
+        if (buf_init(&head, 0) == -1 || buf_slice(segs, IP_FRAG_MAX_SEGS, buf, offset, size) == -1) {
+            printf("failed to fragment buffer\n");
+            break;
+        }
+        buf_add_header(&head, sizeof(ip_hdr_t));
+        ip_hdr_t *iph = (ip_hdr_t *)head.data;
+        memcpy(iph, hdr, sizeof(ip_hdr_t));
+        iph->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+        iph->total_len16 = swap16(sizeof(ip_hdr_t) + size);
+        int more = offset + size < len || (fragment & IP_MORE_FRAGMENT);
+        iph->flags_fragment16 = swap16(flags | (base + offset / IP_HDR_OFFSET_PER_BYTE) | (more ? IP_MORE_FRAGMENT : 0));
+        iph->hdr_checksum16 = 0;
+        iph->hdr_checksum16 = checksum16((uint16_t *)iph, sizeof(ip_hdr_t));
+        head.if_index = netif->index;
+        head.next = segs;
+        arp_out_cached(&head, via, nh);
+    }
+    buf_free(&head);
+}
+
+/**
+ * @brief 内部函数，转发一个目的地址不是本机的数据包
+ *        TTL原地减一并增量更新首部校验和，以太网头写回原帧的头部空间，数据包不做拷贝
+ *        经网关转发时直接使用下一跳中缓存的网关mac，发出的帧进入驱动的发送队列成批发出
+ *        超过出口网卡MTU的数据包设置了DF时回复icmp需要分片，否则分片转发，分片的负载仍引用原帧(RFC 1812 5.2.6)
+ * 
+ * @param buf 带ip头的数据包
+ * @param src_ip 源ip地址
+ */
+static void ip_forward(buf_t *buf, uint8_t *src_ip)
+{
+    ip_hdr_t *iph = (ip_hdr_t *)buf->data;
+    if (iph->ttl <= 1) {
+        ip_stats.ttl_exceeded++;
+        icmp_time_exceeded(buf, src_ip);
+        return;
+    }
+    route_nh_t *nh = route_lookup(iph->dst_ip);
+    if (nh == NULL) {
+        ip_stats.no_route++;
+        icmp_unreachable(buf, src_ip, ICMP_CODE_NET_UNREACH);
+        return;
+    }
+    net_if_t *netif = &net_ifs[nh->if_index];
+    int too_big = swap16(iph->total_len16) > netif->mtu;
+    if (too_big && (swap16(iph->flags_fragment16) & IP_DONT_FRAGMENT)) {
+        // 设置了DF的告知源主机出口MTU
+        ip_stats.too_big++;
+        icmp_frag_needed(buf, src_ip, netif->mtu);
+        return;
+    }
+    uint16_t old_word, new_word;
+    memcpy(&old_word, &iph->ttl, sizeof(old_word));
+    iph->ttl--;
+    memcpy(&new_word, &iph->ttl, sizeof(new_word));
+    iph->hdr_checksum16 = checksum_adjust16(iph->hdr_checksum16, old_word, new_word);
+    ip_stats.forwarded++;
+    buf->if_index = nh->if_index;
+    int gateway = *(uint32_t *)nh->gateway != 0;
+    if (too_big) {
+        ip_hdr_t hdr = *iph;
+        ip_stats.fragmented++;
+        buf_remove_header(buf, iph->hdr_len * IP_HDR_LEN_PER_BYTE);
+        ip_fragment_chain(buf, &hdr, (netif->mtu - sizeof(ip_hdr_t)) & ~(size_t)(IP_HDR_OFFSET_PER_BYTE - 1), netif,
+                          gateway ? nh->gateway : hdr.dst_ip, gateway ? &nh->cache : NULL);
+    } else if (gateway)
+        arp_out_cached(buf, nh->gateway, &nh->cache);
+    else
+        arp_out(buf, iph->dst_ip);
+}
+
+/**
+ * @brief 处理一个收到的数据包
+ * 
+ * @param buf 要处理的数据包
+ * @param src_mac 源mac地址
+ */
+void ip_in(buf_t *buf, uint8_t *src_mac)
+{
+    // TO-DO
+    uint8_t protocal;
+    uint8_t src_ip[NET_IP_LEN];
+    int ret = ip_strip(buf, &protocal, src_ip);
+    if (ret == -1)
+        return;
+    if (ret == 1) {
+        ip_reass_in(buf, protocal, src_ip);
+        return;
+    }
+    if (ret == 2) {
+        ip_forward(buf, src_ip);
+        return;
+    }
+    if (net_in(buf, protocal, src_ip) == -1)
+        ip_unreachable(buf, src_ip);
+}
+
+/**
+ * @brief 批量处理一组收到的数据包
+ *        先对整组检查并去掉ip头，再把留下的数据包按上层协议成组交给上层
+ * 
+ * @param bufs 要处理的数据包，最多NET_BURST_SIZE个
+ * @param src_macs 每个包的源mac地址
+ * @param n 数据包个数
+ */
+void ip_in_burst(buf_t **bufs, uint8_t **src_macs, int n)
+{
+    buf_t *vec[NET_BURST_SIZE];
+    uint8_t ips[NET_BURST_SIZE][NET_IP_LEN];
+    uint8_t *srcs[NET_BURST_SIZE];
+    uint16_t protos[NET_BURST_SIZE];
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        uint8_t protocol;
+        if (i + 1 < n)
+            __builtin_prefetch(bufs[i + 1]->data); // 处理当前包时预取下一个包的头部
+        uint8_t *src_ip = ips[m];
+        int ret = ip_strip(bufs[i], &protocol, src_ip);
+        if (ret == -1)
+            continue;
+        if (ret == 1) {
+            // 分片可能使数据报完整而立即交给上层，先交出已积攒的包以保持顺序
+            net_in_vector(vec, srcs, protos, m, ip_unreachable);
+            m = 0;
+            ip_reass_in(bufs[i], protocol, src_ip);
+            continue;
+        }
+        if (ret == 2) {
+            ip_forward(bufs[i], src_ip); // 转发的包不交给上层，与本机的包之间无需保持顺序
+            continue;
+        }
+        protos[m] = protocol;
+        vec[m] = bufs[i];
+        srcs[m] = ips[m];
+        m++;
+    }
+    net_in_vector(vec, srcs, protos, m, ip_unreachable);
+}
+
+/**
+ * @brief 处理一个要发送的ip分片，从buf->if_index指明的网卡发出，源地址为该网卡的地址
  * 
  * @param buf 要发送的分片
  * @param ip 目标ip地址
  * @param protocol 上层协议
  * @param id 数据包id
  * @param offset 分片offset，必须被8整除
- * @param mf 分片mf标志，是否有下一个分片
+ * @param flags 标志位，IP_MORE_FRAGMENT表示有下一个分片，IP_DONT_FRAGMENT表示不允许路由器分片
+ * @param via 下一跳地址，即路由给出的网关或直连时的目标地址
+ * @param nh 下一跳缓存，为NULL时查arp表
  */
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, uint16_t flags, uint8_t *via, arp_cache_t *nh)
 {
     // TO-DO
     buf_add_header(buf, sizeof(ip_hdr_t));
@@ -76,18 +474,21 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     iph->version = IP_VERSION_4;
     iph->hdr_len = 5;
     iph->tos = 0x0;
-    iph->total_len16 = swap16(buf->len);
+    iph->total_len16 = swap16(buf_chain_len(buf));
     iph->id16 = swap16(id);
-    iph->flags_fragment16 = swap16(mf << 13 | offset);
+    iph->flags_fragment16 = swap16(flags | offset);
     iph->hdr_checksum16 = 0x0;
     iph->protocol = protocol;
     iph->ttl = IP_DEFALUT_TTL;
     memmove(iph->dst_ip, ip, NET_IP_LEN);
-    memmove(iph->src_ip, net_if_ip, NET_IP_LEN);
+    memmove(iph->src_ip, net_ifs[buf->if_index].ip, NET_IP_LEN);
 
     iph->hdr_checksum16 = checksum16((uint16_t *)buf->data, sizeof(ip_hdr_t));
 
-    arp_out(buf, ip);
+    if (nh)
+        arp_out_cached(buf, via, nh);
+    else
+        arp_out(buf, via);
 }
 
 /**
@@ -98,34 +499,117 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
  * @param protocol 上层协议
  */
 void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    ip_out_cached(buf, ip, protocol, NULL);
+}
+
+/**
+ * @brief 内部函数，获取经由某个网卡发往某个地址的路径MTU
+ * 
+ * @param ip 目标ip地址
+ * @param mtu 出口网卡的MTU
+ * @return uint16_t 路径MTU，没有更小的缓存时为网卡的MTU
+ */
+static uint16_t ip_pmtu(const uint8_t *ip, uint16_t mtu)
+{
+    if (map_size(&ip_pmtu_table) == 0) // 通常没有缓存，不必计算哈希
+        return mtu;
+    uint16_t *cached = map_get(&ip_pmtu_table, ip);
+    return cached && *cached < mtu ? *cached : mtu;
+}
+
+/**
+ * @brief 获取发往某个地址的路径MTU，供TCP等上层协议限制报文段大小
+ * 
+ * @param ip 目标ip地址
+ * @return uint16_t 路径MTU，没有路由时为默认网卡的MTU
+ */
+uint16_t ip_path_mtu(const uint8_t *ip)
+{
+    route_nh_t *route = route_lookup(ip);
+    return ip_pmtu(ip, net_ifs[route ? route->if_index : 0].mtu);
+}
+
+/**
+ * @brief 收到icmp需要分片，降低原数据报目的地址的路径MTU
+ *        只接受本机发出且设置了DF的数据报引发的报文，路径MTU只降不升，老化后才恢复(RFC 1191)
+ * 
+ * @param orig 差错报文中引用的原数据报首部
+ * @param mtu 下一跳MTU，为0时按原数据报长度取下一个更小的常见MTU
+ */
+void ip_pmtu_update(const ip_hdr_t *orig, uint16_t mtu)
+{
+    route_nh_t *route = route_lookup(orig->dst_ip);
+    if (route == NULL || !net_if_find(orig->src_ip) || !(swap16(orig->flags_fragment16) & IP_DONT_FRAGMENT))
+        return;
+    if (mtu == 0) {
+        uint16_t len = swap16(orig->total_len16);
+        size_t i = 0;
+        while (i + 1 < sizeof(ip_pmtu_plateaus) / sizeof(ip_pmtu_plateaus[0]) && ip_pmtu_plateaus[i] >= len)
+            i++;
+        mtu = ip_pmtu_plateaus[i];
+    }
+    if (mtu < IP_PMTU_MIN)
+        mtu = IP_PMTU_MIN;
+    if (mtu >= ip_pmtu(orig->dst_ip, net_ifs[route->if_index].mtu))
+        return;
+    if (map_set(&ip_pmtu_table, orig->dst_ip, &mtu) == 0)
+        ip_stats.pmtu_updates++;
+}
+
+/**
+ * @brief 经由缓存的下一跳发送一个ip数据包，供已建立的连接等固定目的地址的发送方使用
+ *        出口网卡由路由决定，按路径MTU分片
+ *        TCP报文段设置DF，路径上更小的MTU以icmp告知后由TCP缩小报文段；其他协议无法调整包长，不设置DF
+ * 
+ * @param buf 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ * @param nh 下一跳缓存，为NULL时查arp表
+ */
+void ip_out_cached(buf_t *buf, uint8_t *ip, net_protocol_t protocol, arp_cache_t *nh)
 {
     // TO-DO
-    size_t len = buf->len;
-    size_t max_data =  ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t);
-    uint16_t offset = 0;
-    id++;
-    if (len <= max_data) {
-        ip_fragment_out(buf, ip, protocol, id, offset, 0);
+    size_t len = buf_chain_len(buf);
+    route_nh_t *route = route_lookup(ip);
+    if (route == NULL) {
+        printf("no route to %s\n", iptos(ip));
         return;
     }
-    uint16_t add = max_data / IP_HDR_OFFSET_PER_BYTE;
-    while(1) {
-        buf_init(&txbuf, ETHERNET_MAX_TRANSPORT_UNIT);
-        
-        if (len > max_data) {
-            memmove(txbuf.data, buf->data, max_data);
-            txbuf.len = max_data;
-            buf->data += max_data;
-            ip_fragment_out(&txbuf, ip, protocol, id, offset, 1);
-            len -= max_data;
-            offset +=  add;
-            continue;
-        }
-        memmove(txbuf.data, buf->data, len);
-        txbuf.len = len;
-        ip_fragment_out(&txbuf, ip, protocol, id, offset, 0);
+    net_if_t *netif = &net_ifs[route->if_index];
+    uint8_t *via = *(uint32_t *)route->gateway ? route->gateway : ip;
+    uint16_t mtu = ip_pmtu(ip, netif->mtu);
+    size_t max_data = mtu - sizeof(ip_hdr_t);
+    buf->if_index = netif->index;
+    id++;
+    if (len <= max_data) {
+        // 路径MTU已降到下限时不再设置DF，由路由器分片
+        int df = protocol == NET_PROTOCOL_TCP && mtu > IP_PMTU_MIN;
+        ip_fragment_out(buf, ip, protocol, id, 0, df ? IP_DONT_FRAGMENT : 0, via, nh);
         return;
     }
+    max_data &= ~(size_t)(IP_HDR_OFFSET_PER_BYTE - 1); // 除最后一个分片外，分片负载长度必须被8整除
+    ip_hdr_t hdr = {0};
+    hdr.version = IP_VERSION_4;
+    hdr.id16 = swap16(id);
+    hdr.ttl = IP_DEFALUT_TTL;
+    hdr.protocol = protocol;
+    memcpy(hdr.src_ip, netif->ip, NET_IP_LEN);
+    memcpy(hdr.dst_ip, ip, NET_IP_LEN);
+    ip_fragment_chain(buf, &hdr, max_data, netif, via, nh);
+}
+
+/**
+ * @brief 选取发往某个地址的数据包的源地址，即路由给出的出口网卡的地址
+ *        上层协议据此计算伪首部校验和，与ip_out填写的源地址一致
+ * 
+ * @param ip 目标ip地址
+ * @return uint8_t* 源ip地址，没有路由时为默认网卡的地址
+ */
+uint8_t *ip_source(const uint8_t *ip)
+{
+    route_nh_t *route = route_lookup(ip);
+    return net_ifs[route ? route->if_index : 0].ip;
 }
 
 /**
@@ -134,5 +618,23 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
  */
 void ip_init()
 {
+    route_init();
+    // 每个网卡的子网作为直连路由，未配置默认网关时默认网卡的子网已被经由它的0/0直连路由覆盖
+    for (int i = 0; i < net_if_count; i++) {
+#ifndef NET_IF_GATEWAY
+        if (i == 0)
+            continue;
+#endif
+        route_add(net_ifs[i].ip, net_ifs[i].prefix_len, NULL, i);
+    }
+#ifdef NET_IF_GATEWAY
+    uint8_t gateway[] = NET_IF_GATEWAY;
+    route_add((uint8_t[NET_IP_LEN]){0}, 0, gateway, 0);
+#else
+    route_add((uint8_t[NET_IP_LEN]){0}, 0, NULL, 0);
+#endif
+    map_init(&ip_reass_table, sizeof(ip_reass_key_t), sizeof(ip_reass_t), 0, IP_REASS_TIMEOUT_SEC, NULL, ip_reass_free);
+    map_init(&ip_pmtu_table, NET_IP_LEN, sizeof(uint16_t), IP_PMTU_MAX_ENTRIES, IP_PMTU_TIMEOUT_SEC, NULL, NULL);
     net_add_protocol(NET_PROTOCOL_IP, ip_in);
+    net_add_burst_protocol(NET_PROTOCOL_IP, ip_in_burst);
 }
\ No newline at end of file
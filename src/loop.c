@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <time.h>
+#include "loop.h"
+#include "driver.h"
+#include "clock.h"
+#include "timer.h"
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief 等待网卡描述符与定时器描述符的epoll实例，为-1表示只能定时休眠
+ *
+ */
+static int loop_epfd = -1;
+
+/**
+ * @brief 按最早到期的协议栈定时器设置的timerfd
+ *
+ */
+static int loop_timerfd = -1;
+
+/**
+ * @brief 最近一次收到数据包的单调时钟时间(微秒)
+ *
+ */
+static uint64_t loop_active_us;
+
+/**
+ * @brief 读取单调时钟，忙轮询的计时不受系统时间调整影响
+ *
+ * @return uint64_t 微秒时间戳
+ */
+static uint64_t loop_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief 计算距离最早到期的协议栈定时器的时间
+ *
+ * @return uint64_t 毫秒数，没有定时器时为UINT64_MAX
+ */
+static uint64_t loop_timer_delay()
+{
+    uint64_t expire = timer_next_expire();
+    if (expire == UINT64_MAX)
+        return UINT64_MAX;
+    return expire > clock_now_ms() ? expire - clock_now_ms() : 0;
+}
+
+/**
+ * @brief 初始化事件循环，在net_init之后调用
+ *        驱动为每个网卡都提供可等待的描述符时用epoll同时等待它们和timerfd，否则空闲时定时休眠
+ *
+ * @return int 成功为0，失败为-1
+ */
+int loop_init()
+{
+    loop_active_us = loop_now_us();
+#ifdef __linux__
+    for (int i = 0; i < net_if_count; i++)
+        if (driver_fd(&net_ifs[i]) < 0)
+            return 0;
+    if ((loop_epfd = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+        (loop_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+    {
+        perror("Error in loop_init");
+        loop_close();
+        return -1;
+    }
+    struct epoll_event tev = {.events = EPOLLIN, .data.fd = loop_timerfd};
+    int ret = epoll_ctl(loop_epfd, EPOLL_CTL_ADD, loop_timerfd, &tev);
+    for (int i = 0; i < net_if_count && ret != -1; i++)
+    {
+        struct epoll_event ev = {.events = EPOLLIN, .data.fd = driver_fd(&net_ifs[i])};
+        ret = epoll_ctl(loop_epfd, EPOLL_CTL_ADD, ev.data.fd, &ev);
+    }
+    if (ret == -1)
+    {
+        perror("Error in epoll_ctl");
+        loop_close();
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief 主循环每轮处理完后调用，决定继续忙轮询还是阻塞等待
+ *        有流量或流量停止不足LOOP_BUSY_POLL_US时立即返回，保持低延迟；
+ *        否则阻塞到有数据包到达或最早的协议栈定时器到期，空闲时不占用CPU
+ *
+ * @param events 本轮net_poll收到的数据包个数
+ */
+void loop_wait(int events)
+{
+    driver_flush(); // 阻塞前发出应用层在本轮排队的数据包
+    uint64_t now = loop_now_us();
+    if (events > 0)
+    {
+        loop_active_us = now;
+        return;
+    }
+    if (now - loop_active_us < LOOP_BUSY_POLL_US)
+        return;
+
+    uint64_t delay = loop_timer_delay();
+#ifdef __linux__
+    if (loop_epfd != -1)
+    {
+        struct itimerspec its = {0}; // 全0表示解除定时器
+        if (delay != UINT64_MAX)
+        {
+            its.it_value.tv_sec = delay / 1000;
+            its.it_value.tv_nsec = delay % 1000 * 1000000 + 1; // 已到期时也不能全为0
+        }
+        timerfd_settime(loop_timerfd, 0, &its, NULL); // 重新设置同时清除上次的到期计数，无需读取
+        struct epoll_event evs[2];
+        epoll_wait(loop_epfd, evs, 2, -1);
+        return;
+    }
+#endif
+    if (delay > LOOP_IDLE_SLEEP_MS)
+        delay = LOOP_IDLE_SLEEP_MS;
+    struct timespec ts = {delay / 1000, delay % 1000 * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief 关闭事件循环
+ *
+ */
+void loop_close()
+{
+#ifdef __linux__
+    if (loop_timerfd != -1)
+        close(loop_timerfd);
+    if (loop_epfd != -1)
+        close(loop_epfd);
+#endif
+    loop_epfd = loop_timerfd = -1;
+}
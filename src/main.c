@@ -3,7 +3,7 @@
 #include "tcp.h"
 #include "http.h"
 #include "driver.h"
-#include "time.h"
+#include "loop.h"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat="
@@ -41,6 +41,11 @@ int main(int argc, char const *argv[])
         printf("net init failed.");
         return -1;
     }
+    if (loop_init() != 0)
+    {
+        printf("loop init failed.");
+        return -1;
+    }
 #ifdef UDP
     udp_open(60000, udp_handler); //注册端口的udp监听回调
 #endif
@@ -53,13 +58,11 @@ int main(int argc, char const *argv[])
     while (1) 
 	{
         //一次主循环
-        net_poll(); //一次主循环
+        int n = net_poll(); //一次主循环
 #ifdef HTTP
         http_server_run();
 #endif
-        // 节约用电
-        struct timespec sleepTime = { 0, 1000000 };
-        nanosleep(&sleepTime, NULL);
+        loop_wait(n); //流量停止一段时间后阻塞等待，节约用电
     }
 
     return 0;
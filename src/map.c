@@ -1,34 +1,44 @@
+#include <stddef.h>
 #include <string.h>
 #include "map.h"
+#include "clock.h"
+
+#define MAP_NIL UINT32_MAX //空链表位置
+
+static void map_expire(void *arg);
 
 /**
- * @brief 初始化map
- * 
+ * @brief 初始化map，存储空间在第一次插入时才分配
+ *        map必须是零初始化的或已经初始化过的，重新初始化时先析构原有的值、释放存储空间并取消定时器
+ *
  * @param map 要初始化的map
  * @param key_len 键的长度
  * @param value_len 值的长度
- * @param max_size 最大容量，为0则根据MAP_MAX_LEN自动设置
+ * @param max_size 容量上限，为0则不限，存储空间随负载自动伸缩
  * @param timeout 超时秒数，为0则永不超时
  * @param value_constuctor 形如memcpy的构造函数，用于拷贝值到容器中，为NULL则使用memcpy
+ * @param value_destructor 值的析构函数，值被覆盖或删除前调用，为NULL则不调用
  */
-void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_size, time_t timeout, map_constuctor_t value_constuctor)
+void map_init(map_t *map, size_t key_len, size_t value_len, size_t max_size, time_t timeout, map_constuctor_t value_constuctor, map_destructor_t value_destructor)
 {
-    if (max_size == 0 || max_size * (key_len + value_len + sizeof(time_t)) > MAP_MAX_LEN)
-        max_size = MAP_MAX_LEN / (key_len + value_len + sizeof(time_t));
     if (value_constuctor == NULL)
         value_constuctor = (map_constuctor_t)memcpy;
-
+    map_destroy(map); // 定时器可能仍挂在时间轮上，清零前必须先摘下
     memset(map, 0, sizeof(map_t));
     map->key_len = key_len;
     map->value_len = value_len;
+    map->entry_len = key_len + value_len + sizeof(time_t) + 2 * sizeof(uint32_t);
     map->max_size = max_size;
     map->timeout = timeout;
     map->value_constuctor = value_constuctor;
+    map->value_destructor = value_destructor;
+    map->lru_head = map->lru_tail = MAP_NIL;
+    timer_setup(&map->timer, map_expire, map);
 }
 
 /**
  * @brief 获取map当前大小
- * 
+ *
  * @param map 要获取的map
  * @return size_t map大小
  */
@@ -37,56 +47,302 @@ size_t map_size(map_t *map)
     return map->size;
 }
 
+/**
+ * @brief 内部函数，计算键的哈希值(FNV-1a)，保证结果非0
+ *
+ * @param map 所属的map
+ * @param key 键指针
+ * @return uint32_t 哈希值
+ */
+static uint32_t map_hash(map_t *map, const void *key)
+{
+    const uint8_t *p = key;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < map->key_len; i++)
+        hash = (hash ^ p[i]) * 16777619u;
+    hash ^= hash >> 16;
+    return hash ? hash : 1;
+}
+
 /**
  * @brief 内部函数，获取第n个物理位置的键值对
- * 
+ *
  * @param map 要获取的map
  * @param pos 位置
  * @return void* 键值对指针
  */
-void *map_entry_get(map_t *map, size_t pos)
+static inline uint8_t *map_entry_get(map_t *map, size_t pos)
 {
-    if (pos >= map->max_size)
-        return NULL;
-    return map->data + pos * (map->key_len + map->value_len + sizeof(time_t));
+    return map->entries + pos * map->entry_len;
 }
 
 /**
- * @brief 内部函数，判断键值对是否有效
- * 
- * @param map 要判断的map
+ * @brief 内部函数，获取键值对的时间戳指针
+ *
+ * @param map 所属的map
  * @param entry 键值对指针
- * @return int 1为合法，0为不合法
+ * @return time_t* 时间戳指针
+ */
+static inline time_t *map_entry_time(map_t *map, uint8_t *entry)
+{
+    return (time_t *)(entry + map->key_len + map->value_len);
+}
+
+/**
+ * @brief 内部函数，获取键值对在超时链表中的前驱与后继位置
+ *
+ * @param map 所属的map
+ * @param pos 键值对位置
+ * @return uint32_t* [前驱, 后继]
+ */
+static inline uint32_t *map_entry_link(map_t *map, uint32_t pos)
+{
+    return (uint32_t *)(map_entry_get(map, pos) + map->key_len + map->value_len + sizeof(time_t));
+}
+
+/**
+ * @brief 内部函数，把键值对追加到超时链表尾部
+ *
+ * @param map 所属的map
+ * @param pos 键值对位置
+ */
+static void map_lru_append(map_t *map, uint32_t pos)
+{
+    uint32_t *link = map_entry_link(map, pos);
+    link[0] = map->lru_tail;
+    link[1] = MAP_NIL;
+    if (map->lru_tail != MAP_NIL)
+        map_entry_link(map, map->lru_tail)[1] = pos;
+    else
+        map->lru_head = pos;
+    map->lru_tail = pos;
+}
+
+/**
+ * @brief 内部函数，把键值对从超时链表中摘下
+ *
+ * @param map 所属的map
+ * @param pos 键值对位置
+ */
+static void map_lru_remove(map_t *map, uint32_t pos)
+{
+    uint32_t *link = map_entry_link(map, pos);
+    if (link[0] != MAP_NIL)
+        map_entry_link(map, link[0])[1] = link[1];
+    else
+        map->lru_head = link[1];
+    if (link[1] != MAP_NIL)
+        map_entry_link(map, link[1])[0] = link[0];
+    else
+        map->lru_tail = link[0];
+}
+
+/**
+ * @brief 内部函数，按超时链表表头重新设置定时器
+ *
+ * @param map 所属的map
+ */
+static void map_timer_update(map_t *map)
+{
+    if (!map->timeout || map->lru_head == MAP_NIL)
+    {
+        timer_cancel(&map->timer);
+        return;
+    }
+    // 时间戳为秒，time + timeout 这一秒结束后才算超时
+    uint64_t expire_ms = (uint64_t)(*map_entry_time(map, map_entry_get(map, map->lru_head)) + map->timeout + 1) * 1000;
+    uint64_t now_ms = clock_now_ms();
+    timer_arm(&map->timer, expire_ms > now_ms ? expire_ms - now_ms : 0);
+}
+
+/**
+ * @brief 内部函数，索引槽距离其理想位置的探测距离
+ *
+ * @param map 所属的map
+ * @param i 索引槽位置
+ * @return size_t 探测距离
+ */
+static inline size_t map_probe_dist(map_t *map, size_t i)
+{
+    return (i - (map->buckets[i].hash & map->bucket_mask)) & map->bucket_mask;
+}
+
+/**
+ * @brief 内部函数，查找键所在的索引槽
+ *
+ * @param map 要查找的map
+ * @param key 键指针
+ * @param hash 键的哈希值
+ * @return long 索引槽位置，找不到为-1
+ */
+static long map_find(map_t *map, const void *key, uint32_t hash)
+{
+    if (map->buckets == NULL)
+        return -1;
+    size_t i = hash & map->bucket_mask;
+    for (size_t dist = 0; map->buckets[i].hash; dist++, i = (i + 1) & map->bucket_mask)
+    {
+        if (map_probe_dist(map, i) < dist)
+            break; // Robin Hood不变式：键若存在必在探测距离更短的槽之前
+        if (map->buckets[i].hash == hash && !memcmp(key, map_entry_get(map, map->buckets[i].pos), map->key_len))
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief 内部函数，将一个条目位置插入哈希索引
+ *
+ * @param map 要操作的map
+ * @param hash 键的哈希值
+ * @param pos 条目位置
+ */
+static void map_index_insert(map_t *map, uint32_t hash, uint32_t pos)
+{
+    map_bucket_t cur = {hash, pos};
+    size_t i = hash & map->bucket_mask;
+    for (size_t dist = 0;; dist++, i = (i + 1) & map->bucket_mask)
+    {
+        if (!map->buckets[i].hash)
+        {
+            map->buckets[i] = cur;
+            return;
+        }
+        size_t exist = map_probe_dist(map, i);
+        if (exist < dist)
+        { // 劫富济贫：与探测距离更短的槽交换后继续插入
+            map_bucket_t tmp = map->buckets[i];
+            map->buckets[i] = cur;
+            cur = tmp;
+            dist = exist;
+        }
+    }
+}
+
+/**
+ * @brief 内部函数，把哈希索引与条目数组伸缩到指定槽数，条目位置不变
+ *
+ * @param map 要操作的map
+ * @param bucket_num 新的索引槽数，为2的幂且能容纳当前所有条目
+ * @return int 成功为0，内存不足为-1
  */
-int map_entry_valid(map_t *map, const void *entry)
+static int map_resize(map_t *map, size_t bucket_num)
 {
-    time_t entry_time = *(time_t *)((uint8_t *)entry + map->key_len + map->value_len);
-    return entry_time && (!map->timeout || entry_time + map->timeout >= time(NULL));
+    size_t capacity = bucket_num - bucket_num / 8; // 装载因子7/8以内Robin Hood探测仍然很短
+    map_bucket_t *buckets = calloc(bucket_num, sizeof(map_bucket_t));
+    if (buckets == NULL)
+        return -1;
+    uint8_t *entries = realloc(map->entries, capacity * map->entry_len);
+    if (entries == NULL)
+    {
+        free(buckets);
+        return -1;
+    }
+    map_bucket_t *old = map->buckets;
+    size_t old_num = old ? map->bucket_mask + 1 : 0;
+    map->buckets = buckets;
+    map->entries = entries;
+    map->capacity = capacity;
+    map->bucket_mask = bucket_num - 1;
+    for (size_t i = 0; i < old_num; i++)
+        if (old[i].hash)
+            map_index_insert(map, old[i].hash, old[i].pos);
+    free(old);
+    return 0;
+}
+
+/**
+ * @brief 内部函数，删除一个索引槽及其条目，条目数组用末尾条目填补空洞
+ *        条目会被memcpy搬移，伸缩时也会随realloc搬移，值中不能有指向自身的指针
+ *
+ * @param map 要操作的map
+ * @param i 索引槽位置
+ */
+static void map_remove_at(map_t *map, size_t i)
+{
+    uint32_t pos = map->buckets[i].pos;
+    // 后移删除：把后继槽依次前移，索引中不留墓碑
+    size_t next = (i + 1) & map->bucket_mask;
+    while (map->buckets[next].hash && map_probe_dist(map, next))
+    {
+        map->buckets[i] = map->buckets[next];
+        i = next;
+        next = (next + 1) & map->bucket_mask;
+    }
+    map->buckets[i].hash = 0;
+    map_lru_remove(map, pos);
+    if (map->value_destructor)
+        map->value_destructor(map_entry_get(map, pos) + map->key_len);
+
+    uint32_t last = map->size - 1;
+    if (pos != last)
+    {
+        uint8_t *entry = map_entry_get(map, last);
+        map->buckets[map_find(map, entry, map_hash(map, entry))].pos = pos;
+        memcpy(map_entry_get(map, pos), entry, map->entry_len);
+        uint32_t *link = map_entry_link(map, pos);
+        if (link[0] != MAP_NIL)
+            map_entry_link(map, link[0])[1] = pos;
+        else
+            map->lru_head = pos;
+        if (link[1] != MAP_NIL)
+            map_entry_link(map, link[1])[0] = pos;
+        else
+            map->lru_tail = pos;
+    }
+    map->size--;
+    // 负载降到四分之一以下时减半，与倍增之间留出滞后区间避免反复伸缩
+    if (map->bucket_mask + 1 > MAP_MIN_BUCKETS && map->size < map->capacity / 4)
+        map_resize(map, (map->bucket_mask + 1) / 2);
+}
+
+/**
+ * @brief 内部函数，从超时链表表头起回收所有已超时的键值对，并重新设置定时器
+ *        作为定时器回调由时间轮驱动，查找时不再需要检查时间戳
+ *
+ * @param arg 要回收的map
+ */
+static void map_expire(void *arg)
+{
+    map_t *map = arg;
+    time_t now = clock_now();
+    while (map->lru_head != MAP_NIL)
+    {
+        uint8_t *entry = map_entry_get(map, map->lru_head);
+        time_t *timestamp = map_entry_time(map, entry);
+        if (*timestamp + map->timeout >= now)
+            break;
+        if (map->expire_handler)
+            map->expire_handler(entry, entry + map->key_len, timestamp);
+        map_remove_at(map, map_find(map, entry, map_hash(map, entry)));
+    }
+    map_timer_update(map);
 }
 
 /**
  * @brief 获取map中指定键的值
- * 
+ *        返回的指针只在对同一map的下一次map_set、map_delete或超时回收之前有效：
+ *        删除会把最后一个键值对搬进空位，插入和删除引起的伸缩会重新分配条目数组，
+ *        跨这些调用使用时要重新map_get
+ *
  * @param map 要获取的map
  * @param key 键指针
- * @return void* 值指针，找不到为NULL 
+ * @return void* 值指针，找不到为NULL
  */
 void *map_get(map_t *map, const void *key)
 {
     if (key == NULL)
         return NULL;
-    for (size_t i = 0; i < map->max_size; i++)
-    {
-        uint8_t *entry = map_entry_get(map, i);
-        if (map_entry_valid(map, entry) && !memcmp(key, entry, map->key_len))
-            return entry + map->key_len;
-    }
-    return NULL;
+    long i = map_find(map, key, map_hash(map, key));
+    if (i < 0)
+        return NULL;
+    return map_entry_get(map, map->buckets[i].pos) + map->key_len;
 }
 
 /**
  * @brief 插入或更新map中指定键的值
- * 
+ *        插入可能使条目数组扩容，达到容量上限时还会先回收超时的键值对，之前由map_get取得的值指针全部失效
+ *
  * @param map 要操作的map
  * @param key 键指针
  * @param value 值指针
@@ -94,59 +350,114 @@ void *map_get(map_t *map, const void *key)
 */
 int map_set(map_t *map, const void *key, const void *value)
 {
-    uint8_t *old_value = map_get(map, key);
-    if (old_value)
+    uint32_t hash = map_hash(map, key);
+    long i = map_find(map, key, hash);
+    uint32_t pos, head = map->lru_head;
+    if (i >= 0)
     {
-        map->value_constuctor(old_value, value, map->value_len);
-        *(time_t *)(old_value + map->value_len) = time(NULL);
-        return 0;
+        pos = map->buckets[i].pos;
+        map_lru_remove(map, pos);
+        if (map->value_destructor)
+            map->value_destructor(map_entry_get(map, pos) + map->key_len);
     }
-    if (map->size == map->max_size)
-        return -1;
-    for (size_t i = 0; i < map->max_size; i++)
+    else
     {
-        uint8_t *entry = map_entry_get(map, i);
-        if (!map_entry_valid(map, entry))
-        {
-            memcpy(entry, key, map->key_len);
-            map->value_constuctor(entry + map->key_len, value, map->value_len);
-            *(time_t *)(entry + map->key_len + map->value_len) = time(NULL);
-            map->size++;
-            return 0;
-        }
+        if (map->max_size && map->size == map->max_size && map->timeout)
+            map_expire(map);
+        if (map->max_size && map->size == map->max_size)
+            return -1;
+        if (map->size == map->capacity && map_resize(map, map->buckets ? 2 * (map->bucket_mask + 1) : MAP_MIN_BUCKETS) < 0)
+            return -1;
+        pos = map->size;
+        memcpy(map_entry_get(map, pos), key, map->key_len);
+        map_index_insert(map, hash, pos);
+        map->size++;
     }
-
-    return -1;
+    uint8_t *entry = map_entry_get(map, pos);
+    map->value_constuctor(entry + map->key_len, value, map->value_len);
+    *map_entry_time(map, entry) = clock_now();
+    map_lru_append(map, pos);
+    if (map->lru_head != head)
+        map_timer_update(map);
+    return 0;
 }
 
 /**
  * @brief 删除map中指定的键
- * 
+ *
  * @param map 要操作的map
  * @param key 键指针
  */
 void map_delete(map_t *map, const void *key)
 {
-    uint8_t *value = map_get(map, key);
-    if (value)
-    {
-        *(time_t *)(value + map->value_len) = 0;
-        map->size--;
-    }
+    if (key == NULL)
+        return;
+    long i = map_find(map, key, map_hash(map, key));
+    if (i < 0)
+        return;
+    uint32_t head = map->lru_head;
+    map_remove_at(map, i);
+    if (map->lru_head != head)
+        map_timer_update(map);
+}
+
+/**
+ * @brief 获取map中最早插入或更新的键值对，用于按先后顺序淘汰
+ *
+ * @param map 要获取的map
+ * @return void* 键指针，值紧随键之后，map为空时为NULL
+ */
+void *map_oldest(map_t *map)
+{
+    return map->lru_head == MAP_NIL ? NULL : map_entry_get(map, map->lru_head);
 }
 
 /**
  * @brief 遍历map
- * 
+ *        回调中可以删除当前键值对，不能插入或删除其他键值对
+ *
  * @param map 要遍历的map
  * @param handler 对每个键值对应用的回调函数，参数为（键指针，值指针，更新时间指针）
  */
 void map_foreach(map_t *map, map_entry_handler_t handler)
 {
-    for (size_t i = 0; i < map->max_size; i++)
+    for (size_t i = 0; i < map->size;)
     {
+        size_t size = map->size;
         uint8_t *entry = map_entry_get(map, i);
-        if (map_entry_valid(map, entry))
-            handler(entry, entry + map->key_len, (time_t *)(entry + map->key_len + map->value_len));
+        handler(entry, entry + map->key_len, map_entry_time(map, entry));
+        if (map->size == size)
+            i++; // 删除当前键值对时末尾的键值对填补到了位置i，需要再访问一次
     }
 }
+
+/**
+ * @brief 注册键值对超时回调，超时的键值对由时间轮主动回收，回收前调用该回调
+ *        回调中不能修改该map
+ *
+ * @param map 要操作的map
+ * @param handler 回调函数，参数为（键指针，值指针，更新时间指针）
+ */
+void map_set_expire_handler(map_t *map, map_entry_handler_t handler)
+{
+    map->expire_handler = handler;
+}
+
+/**
+ * @brief 析构map中所有的值，释放存储空间并取消其定时器，之后可以重新map_init
+ *
+ * @param map 要释放的map
+ */
+void map_destroy(map_t *map)
+{
+    timer_cancel(&map->timer);
+    if (map->value_destructor)
+        for (size_t i = 0; i < map->size; i++)
+            map->value_destructor(map_entry_get(map, i) + map->key_len);
+    free(map->buckets);
+    free(map->entries);
+    map->buckets = NULL;
+    map->entries = NULL;
+    map->size = map->capacity = map->bucket_mask = 0;
+    map->lru_head = map->lru_tail = MAP_NIL;
+}
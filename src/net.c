@@ -1,5 +1,7 @@
 #include "net.h"
 #include "driver.h"
+#include "clock.h"
+#include "timer.h"
 #include "ethernet.h"
 #include "arp.h"
 #include "ip.h"
@@ -7,23 +9,47 @@
 #include "udp.h"
 #include "tcp.h"
 
+typedef struct net_l2_protocol //二层协议表项
+{
+    uint16_t ethertype;        // 协议号
+    net_handler_t handler;     // in处理程序
+    net_burst_handler_t burst; // 批处理程序，为NULL时逐个调用in处理程序
+} net_l2_protocol_t;
+
 /**
- * @brief 协议表 <协议号,处理程序>的容器
+ * @brief 二层协议表，ethertype稀疏且注册的很少，顺序查找比按ethertype直接索引省下大表
  * 
  */
-map_t net_table;
+static net_l2_protocol_t net_l2_table[NET_L2_PROTOCOL_MAX];
+static int net_l2_count;
 
 /**
- * @brief 网卡MAC地址
+ * @brief 三层协议表，按IP上层协议号直接索引处理程序
  * 
  */
-uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
+static net_handler_t net_l3_table[UINT8_MAX + 1];
+
+#ifndef NET_STATIC_DISPATCH
+/**
+ * @brief 二层与三层协议的批处理程序表，未注册批处理程序的协议逐个调用in处理程序
+ * 
+ */
+static net_burst_handler_t net_l3_burst_table[UINT8_MAX + 1];
+#endif
 
 /**
- * @brief 网卡IP地址
+ * @brief 网卡表，第一个是由配置给出的默认网卡
  * 
  */
-uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
+net_if_t net_ifs[NET_IF_MAX] = {
+    {.mac = NET_IF_MAC, .ip = NET_IF_IP, .prefix_len = NET_IF_PREFIX_LEN, .mtu = ETHERNET_MAX_TRANSPORT_UNIT},
+};
+
+/**
+ * @brief 网卡个数
+ * 
+ */
+int net_if_count = 1;
 
 /**
  * @brief 网卡接收和发送缓冲区
@@ -31,15 +57,53 @@ uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
  */
 buf_t rxbuf, txbuf; //一个buf足够单线程使用
 
+/**
+ * @brief 添加一个网卡，在net_init之前调用，net_init时与默认网卡一起打开
+ * 
+ * @param ip 网卡ip地址
+ * @param mac 网卡mac地址
+ * @param prefix_len 所在子网的前缀长度
+ * @return int 网卡序号，网卡数已达上限时为-1
+ */
+int net_if_add(const uint8_t *ip, const uint8_t *mac, uint8_t prefix_len)
+{
+    if (net_if_count == NET_IF_MAX)
+        return -1;
+    net_if_t *netif = &net_ifs[net_if_count];
+    memset(netif, 0, sizeof(net_if_t));
+    netif->index = net_if_count;
+    memcpy(netif->ip, ip, NET_IP_LEN);
+    memcpy(netif->mac, mac, NET_MAC_LEN);
+    netif->prefix_len = prefix_len;
+    netif->mtu = ETHERNET_MAX_TRANSPORT_UNIT;
+    return net_if_count++;
+}
+
+/**
+ * @brief 查找拥有某个ip地址的网卡
+ * 
+ * @param ip ip地址
+ * @return net_if_t* 网卡，不是本机地址时为NULL
+ */
+net_if_t *net_if_find(const uint8_t *ip)
+{
+    for (int i = 0; i < net_if_count; i++)
+        if (!memcmp(net_ifs[i].ip, ip, NET_IP_LEN))
+            return &net_ifs[i];
+    return NULL;
+}
+
 /**
  * @brief 初始化协议栈
  * 
  */
 int   net_init()
 {
-    map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL);
-    if (driver_open() == -1)
-        return -1;
+    for (int i = 0; i < net_if_count; i++)
+        if (driver_open(&net_ifs[i]) == -1)
+            return -1;
+    clock_init();
+    timer_init();
 #ifdef ETHERNET
     ethernet_init();
 #ifdef ARP
@@ -61,19 +125,49 @@ int   net_init()
     return 0;
 }
 
+/**
+ * @brief 内部函数，查找二层协议表项
+ * 
+ * @param ethertype 协议号
+ * @param add 找不到时是否新建表项
+ * @return net_l2_protocol_t* 表项，找不到且不新建或表已满时为NULL
+ */
+static net_l2_protocol_t *net_l2_find(uint16_t ethertype, int add)
+{
+    for (int i = 0; i < net_l2_count; i++)
+        if (net_l2_table[i].ethertype == ethertype)
+            return &net_l2_table[i];
+    if (!add || net_l2_count == NET_L2_PROTOCOL_MAX)
+        return NULL;
+    net_l2_protocol_t *entry = &net_l2_table[net_l2_count++];
+    memset(entry, 0, sizeof(net_l2_protocol_t));
+    entry->ethertype = ethertype;
+    return entry;
+}
+
 /**
  * @brief 向协议栈注册一个协议
+ *        不大于0xFF的协议号是IP上层协议号，否则是ethertype
  * 
  * @param protocol 协议号 
  * @param handler 该协议的in处理程序
  */
 void net_add_protocol(uint16_t protocol, net_handler_t handler)
 {
-    map_set(&net_table, &protocol, &handler);
+    if (protocol <= UINT8_MAX)
+    {
+        net_l3_table[protocol] = handler;
+        return;
+    }
+    net_l2_protocol_t *entry = net_l2_find(protocol, 1);
+    if (entry)
+        entry->handler = handler;
 }
 
+#ifdef NET_STATIC_DISPATCH
 /**
  * @brief 向协议栈的上层协议传递数据包
+ *        协议集在编译期固定，直接分派到各协议的处理程序
  * 
  * @param buf 要传递的数据包
  * @param protocol 上层协议号
@@ -82,22 +176,163 @@ void net_add_protocol(uint16_t protocol, net_handler_t handler)
  */
 int net_in(buf_t *buf, uint16_t protocol, uint8_t *src)
 {
-    net_handler_t *handler = map_get(&net_table, &protocol);
+    switch (protocol)
+    {
+#ifdef ARP
+    case NET_PROTOCOL_ARP:
+        arp_in(buf, src);
+        return 0;
+#endif
+#ifdef IP
+    case NET_PROTOCOL_IP:
+        ip_in(buf, src);
+        return 0;
+#endif
+#ifdef ICMP
+    case NET_PROTOCOL_ICMP:
+        icmp_in(buf, src);
+        return 0;
+#endif
+#ifdef UDP
+    case NET_PROTOCOL_UDP:
+        udp_in(buf, src);
+        return 0;
+#endif
+#ifdef TCP
+    case NET_PROTOCOL_TCP:
+        tcp_in(buf, src);
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+#else
+/**
+ * @brief 向协议栈的上层协议传递数据包
+ *        三层协议直接索引，二层协议在很短的表中顺序查找
+ * 
+ * @param buf 要传递的数据包
+ * @param protocol 上层协议号
+ * @param src 源的本层协议地址，如mac或ip地址
+ * @return int 成功为0，失败为-1
+ */
+int net_in(buf_t *buf, uint16_t protocol, uint8_t *src)
+{
+    net_handler_t handler;
+    if (protocol <= UINT8_MAX)
+        handler = net_l3_table[protocol];
+    else
+    {
+        net_l2_protocol_t *entry = net_l2_find(protocol, 0);
+        handler = entry ? entry->handler : NULL;
+    }
     if (handler)
     {
-        (*handler)(buf, src);
+        handler(buf, src);
         return 0;
     }
     return -1;
 }
+#endif
+
+/**
+ * @brief 向协议栈注册一个协议的批处理程序
+ *        协议号的含义与net_add_protocol相同
+ * 
+ * @param protocol 协议号
+ * @param handler 该协议的批处理程序
+ */
+void net_add_burst_protocol(uint16_t protocol, net_burst_handler_t handler)
+{
+#ifndef NET_STATIC_DISPATCH
+    if (protocol <= UINT8_MAX)
+    {
+        net_l3_burst_table[protocol] = handler;
+        return;
+    }
+    net_l2_protocol_t *entry = net_l2_find(protocol, 1);
+    if (entry)
+        entry->burst = handler;
+#endif
+}
+
+/**
+ * @brief 向协议栈的上层协议传递一组同一协议的数据包
+ *        协议注册了批处理程序时整组交给它，否则逐个交给in处理程序
+ * 
+ * @param bufs 要传递的数据包
+ * @param srcs 每个包的源的本层协议地址
+ * @param n 数据包个数
+ * @param protocol 上层协议号
+ * @return int 成功为0，该协议没有处理程序为-1
+ */
+int net_in_burst(buf_t **bufs, uint8_t **srcs, int n, uint16_t protocol)
+{
+#ifdef NET_STATIC_DISPATCH
+#ifdef IP
+    if (protocol == NET_PROTOCOL_IP)
+    {
+        ip_in_burst(bufs, srcs, n);
+        return 0;
+    }
+#endif
+#else
+    net_burst_handler_t burst;
+    if (protocol <= UINT8_MAX)
+        burst = net_l3_burst_table[protocol];
+    else
+    {
+        net_l2_protocol_t *entry = net_l2_find(protocol, 0);
+        burst = entry ? entry->burst : NULL;
+    }
+    if (burst)
+    {
+        burst(bufs, srcs, n);
+        return 0;
+    }
+#endif
+    for (int i = 0; i < n; i++)
+        if (net_in(bufs[i], protocol, srcs[i]) == -1)
+            return -1; // 有无处理程序只取决于协议，只可能在第一个包失败
+    return 0;
+}
+
+/**
+ * @brief 把一组数据包按上层协议交给下一层
+ *        连续的同协议数据包作为一组一起传递，保持数据包的先后顺序
+ * 
+ * @param bufs 要传递的数据包
+ * @param srcs 每个包的源的本层协议地址
+ * @param protocols 每个包的上层协议号
+ * @param n 数据包个数
+ * @param fail 上层协议没有处理程序时对每个包调用，可为NULL
+ */
+void net_in_vector(buf_t **bufs, uint8_t **srcs, const uint16_t *protocols, int n, net_handler_t fail)
+{
+    for (int i = 0, j; i < n; i = j)
+    {
+        for (j = i + 1; j < n && protocols[j] == protocols[i]; j++)
+            ;
+        if (net_in_burst(bufs + i, srcs + i, j - i, protocols[i]) == -1 && fail)
+            for (int k = i; k < j; k++)
+                fail(bufs[k], srcs[k]);
+    }
+}
 
 /**
  * @brief 一次协议栈轮询
  * 
+ * @return int 本次收到的数据包个数
  */
-void net_poll()
+int net_poll()
 {
+    int n = 0;
+    clock_update();
 #ifdef ETHERNET
-    ethernet_poll();
+    n = ethernet_poll();
 #endif
+    timer_poll();
+    driver_flush(); // 本次轮询中排队的数据包一次发出
+    return n;
 }
\ No newline at end of file
@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include "route.h"
+#include "arp.h"
+
+/**
+ * @brief 短前缀表，按地址最高8位索引，表项含义同一级表，一级表项为0时查找它
+ *        默认路由等短前缀若写入一级表要改写它的全部1600万项，放在这里只需改写至多256项
+ *
+ */
+static uint16_t route_short[1 << ROUTE_SHORT_MAX];
+static uint8_t route_short_depth[1 << ROUTE_SHORT_MAX];
+
+/**
+ * @brief DIR-24-8一级表，按地址高24位索引，表项为0表示没有长于/8的路由，否则为下一跳号+1或二级表组号
+ *        首次添加长于/8的路由时才分配，未写过的页不占物理内存
+ *
+ */
+static uint16_t *route_tbl24;
+
+/**
+ * @brief 一级表每项来自的前缀长度，只在修改路由表时使用，查找时不访问
+ *
+ */
+static uint8_t *route_tbl24_depth;
+
+/**
+ * @brief 二级表，每组256项覆盖一个长于/24的前缀所在的/24，按需扩充
+ *
+ */
+static uint16_t *route_tbl8;
+static uint8_t *route_tbl8_depth;
+static size_t route_tbl8_groups;
+
+/**
+ * @brief 空闲的二级表组号栈
+ *
+ */
+static uint16_t *route_tbl8_free;
+static size_t route_tbl8_free_count;
+
+/**
+ * @brief 下一跳表，表项中的下一跳号是它的下标
+ *
+ */
+static route_nh_t *route_nhs;
+static size_t route_nh_count;
+
+/**
+ * @brief 路由规则，键为前缀，值为一级表项的值，修改路由表时用来找被删除前缀的替代
+ *
+ */
+static map_t route_rules;
+
+/**
+ * @brief 把ip地址转为主机序整数
+ *
+ * @param ip ip地址
+ * @return uint32_t 主机序地址
+ */
+static inline uint32_t route_addr(const uint8_t *ip)
+{
+    return (uint32_t)ip[0] << 24 | (uint32_t)ip[1] << 16 | (uint32_t)ip[2] << 8 | ip[3];
+}
+
+/**
+ * @brief 前缀长度对应的掩码
+ *
+ * @param len 前缀长度
+ * @return uint32_t 主机序掩码
+ */
+static inline uint32_t route_mask(uint8_t len)
+{
+    return len ? UINT32_MAX << (32 - len) : 0;
+}
+
+/**
+ * @brief 生成前缀为addr/len的规则键
+ *
+ * @param key 出口参数，规则键
+ * @param addr 主机序地址，掩码之外的位被清除
+ * @param len 前缀长度
+ */
+static void route_key(route_key_t *key, uint32_t addr, uint8_t len)
+{
+    memset(key, 0, sizeof(route_key_t));
+    addr &= route_mask(len);
+    for (int i = 0; i < NET_IP_LEN; i++)
+        key->prefix[i] = addr >> (24 - 8 * i);
+    key->len = len;
+}
+
+/**
+ * @brief 取得一个下一跳的引用，相同的网关和网卡共用一项
+ *
+ * @param gateway 网关地址，为NULL或全0表示直连
+ * @param if_index 出口网卡序号
+ * @return int 下一跳号，下一跳表已满或内存不足时为-1
+ */
+static int route_nh_get(uint8_t *gateway, uint8_t if_index)
+{
+    route_nh_t nh = {.if_index = if_index};
+    if (gateway)
+        memcpy(nh.gateway, gateway, NET_IP_LEN);
+    size_t idle = route_nh_count;
+    for (size_t i = 0; i < route_nh_count; i++)
+    {
+        if (route_nhs[i].refs == 0)
+            idle = min32(idle, i);
+        else if (!memcmp(route_nhs[i].gateway, nh.gateway, NET_IP_LEN) && route_nhs[i].if_index == if_index)
+        {
+            route_nhs[i].refs++;
+            return i;
+        }
+    }
+    if (idle == route_nh_count)
+    {
+        if (route_nh_count == ROUTE_INDEX_MASK)
+            return -1;
+        route_nh_t *nhs = realloc(route_nhs, (route_nh_count + 1) * sizeof(route_nh_t));
+        if (nhs == NULL)
+            return -1;
+        route_nhs = nhs;
+        route_nh_count++;
+    }
+    nh.refs = 1;
+    route_nhs[idle] = nh;
+    return idle;
+}
+
+/**
+ * @brief 分配一个二级表组，填入它所在一级表项原来的值
+ *
+ * @param value 一级表项原来的值
+ * @param depth 一级表项原来的前缀长度
+ * @return int 组号，组号用尽或内存不足时为-1
+ */
+static int route_tbl8_alloc(uint16_t value, uint8_t depth)
+{
+    if (route_tbl8_free_count == 0)
+    {
+        size_t groups = min32(route_tbl8_groups + ROUTE_TBL8_GROW, ROUTE_INDEX_MASK + 1);
+        if (groups == route_tbl8_groups)
+            return -1;
+        uint16_t *tbl = realloc(route_tbl8, groups * ROUTE_TBL8_LEN * sizeof(uint16_t));
+        if (tbl == NULL)
+            return -1;
+        route_tbl8 = tbl;
+        uint8_t *depths = realloc(route_tbl8_depth, groups * ROUTE_TBL8_LEN);
+        if (depths == NULL)
+            return -1;
+        route_tbl8_depth = depths;
+        uint16_t *free_groups = realloc(route_tbl8_free, groups * sizeof(uint16_t));
+        if (free_groups == NULL)
+            return -1;
+        route_tbl8_free = free_groups;
+        while (groups > route_tbl8_groups)
+            route_tbl8_free[route_tbl8_free_count++] = --groups;
+        route_tbl8_groups += route_tbl8_free_count;
+    }
+    uint16_t group = route_tbl8_free[--route_tbl8_free_count];
+    for (size_t i = 0; i < ROUTE_TBL8_LEN; i++)
+    {
+        route_tbl8[group * ROUTE_TBL8_LEN + i] = value;
+        route_tbl8_depth[group * ROUTE_TBL8_LEN + i] = depth;
+    }
+    return group;
+}
+
+/**
+ * @brief 二级表组中不再有长于/24的前缀时，收回到一级表并释放该组
+ *
+ * @param i 一级表下标
+ */
+static void route_tbl8_collapse(size_t i)
+{
+    uint16_t group = route_tbl24[i] & ROUTE_INDEX_MASK;
+    uint8_t *depths = route_tbl8_depth + group * ROUTE_TBL8_LEN;
+    for (size_t j = 0; j < ROUTE_TBL8_LEN; j++)
+        if (depths[j] > 24)
+            return;
+    // 剩下的都来自同一条不长于/24的前缀，取值相同
+    route_tbl24[i] = route_tbl8[group * ROUTE_TBL8_LEN];
+    route_tbl24_depth[i] = depths[0];
+    route_tbl8_free[route_tbl8_free_count++] = group;
+}
+
+/**
+ * @brief 改写表项的一段，区间内的各项按前缀长度决定是否改写
+ *
+ * @param values 表项
+ * @param depths 表项的前缀长度
+ * @param n 区间长度
+ * @param len 被添加或删除的前缀长度
+ * @param value 新的表项值
+ * @param depth 新的前缀长度
+ * @param replace 为0时改写不比len更长的项(添加)，否则只改写恰为len的项(替换或删除)
+ */
+static void route_fill(uint16_t *values, uint8_t *depths, size_t n, uint8_t len, uint16_t value, uint8_t depth, int replace)
+{
+    for (size_t i = 0; i < n; i++)
+        if (replace ? depths[i] == len : depths[i] <= len)
+            values[i] = value, depths[i] = depth;
+}
+
+/**
+ * @brief 把前缀addr/len覆盖的表项改为value
+ *
+ * @param addr 主机序前缀
+ * @param len 前缀长度
+ * @param value 新的表项值
+ * @param depth 新的前缀长度
+ * @param replace 同route_fill
+ * @return int 成功为0，二级表分配失败为-1，此时表未被修改
+ */
+static int route_paint(uint32_t addr, uint8_t len, uint16_t value, uint8_t depth, int replace)
+{
+    if (len <= ROUTE_SHORT_MAX)
+    {
+        size_t start = addr >> (32 - ROUTE_SHORT_MAX);
+        route_fill(route_short + start, route_short_depth + start, (size_t)1 << (ROUTE_SHORT_MAX - len), len, value, depth, replace);
+        return 0;
+    }
+    if (len <= 24)
+    {
+        size_t start = addr >> 8, end = start + ((size_t)1 << (24 - len));
+        for (size_t i = start; i < end; i++)
+        {
+            if (route_tbl24[i] & ROUTE_EXT)
+            {
+                size_t group = (route_tbl24[i] & ROUTE_INDEX_MASK) * ROUTE_TBL8_LEN;
+                route_fill(route_tbl8 + group, route_tbl8_depth + group, ROUTE_TBL8_LEN, len, value, depth, replace);
+            }
+            else
+                route_fill(route_tbl24 + i, route_tbl24_depth + i, 1, len, value, depth, replace);
+        }
+        return 0;
+    }
+    size_t i = addr >> 8;
+    if (!(route_tbl24[i] & ROUTE_EXT))
+    {
+        if (replace)
+            return 0; // 没有二级表就没有长于/24的项可改写
+        int group = route_tbl8_alloc(route_tbl24[i], route_tbl24_depth[i]);
+        if (group == -1)
+            return -1;
+        route_tbl24[i] = ROUTE_EXT | group;
+    }
+    size_t group = (route_tbl24[i] & ROUTE_INDEX_MASK) * ROUTE_TBL8_LEN + (addr & 0xff);
+    route_fill(route_tbl8 + group, route_tbl8_depth + group, (size_t)1 << (32 - len), len, value, depth, replace);
+    if (replace)
+        route_tbl8_collapse(i);
+    return 0;
+}
+
+/**
+ * @brief 最长前缀匹配查找路由，一级表命中时只访问一次内存，长于/24的前缀再访问一次二级表
+ *        没有长于/8的前缀匹配时再查短前缀表
+ *        返回的指针在下一次修改路由表之前有效
+ *
+ * @param ip 目的ip地址
+ * @return route_nh_t* 下一跳，没有匹配的路由时为NULL
+ */
+route_nh_t *route_lookup(const uint8_t *ip)
+{
+    uint32_t addr = route_addr(ip);
+    uint16_t value = 0;
+    if (route_tbl24)
+    {
+        value = route_tbl24[addr >> 8];
+        if (value & ROUTE_EXT)
+            value = route_tbl8[(value & ROUTE_INDEX_MASK) * ROUTE_TBL8_LEN + (addr & 0xff)];
+    }
+    if (value == 0)
+        value = route_short[addr >> (32 - ROUTE_SHORT_MAX)];
+    return value ? &route_nhs[value - 1] : NULL;
+}
+
+/**
+ * @brief 添加路由，已有相同前缀的路由时替换它的下一跳
+ *        路由变化后缓存的下一跳mac全部失效
+ *
+ * @param prefix 前缀，掩码之外的位被忽略
+ * @param len 前缀长度
+ * @param gateway 网关地址，为NULL或全0表示直连
+ * @param if_index 出口网卡序号
+ * @return int 成功为0，失败为-1
+ */
+int route_add(uint8_t *prefix, uint8_t len, uint8_t *gateway, uint8_t if_index)
+{
+    if (len > 32)
+        return -1;
+    if (len > ROUTE_SHORT_MAX && route_tbl24 == NULL)
+    {
+        route_tbl24 = calloc(ROUTE_TBL24_LEN, sizeof(uint16_t));
+        route_tbl24_depth = calloc(ROUTE_TBL24_LEN, 1);
+        if (route_tbl24 == NULL || route_tbl24_depth == NULL)
+        {
+            free(route_tbl24);
+            free(route_tbl24_depth);
+            route_tbl24 = NULL;
+            route_tbl24_depth = NULL;
+            return -1;
+        }
+    }
+    int nh = route_nh_get(gateway, if_index);
+    if (nh == -1)
+        return -1;
+    uint16_t value = nh + 1;
+    uint32_t addr = route_addr(prefix) & route_mask(len);
+    route_key_t key;
+    route_key(&key, addr, len);
+    uint16_t *rule = map_get(&route_rules, &key);
+    uint16_t old = rule ? *rule : 0;
+    if (map_set(&route_rules, &key, &value) == -1 || route_paint(addr, len, value, len, old != 0) == -1)
+    {
+        if (old)
+            map_set(&route_rules, &key, &old);
+        else
+            map_delete(&route_rules, &key);
+        route_nhs[nh].refs--;
+        return -1;
+    }
+    if (old)
+        route_nhs[old - 1].refs--;
+    arp_generation++;
+    return 0;
+}
+
+/**
+ * @brief 删除路由，它覆盖的地址改由次长的匹配前缀接管
+ *
+ * @param prefix 前缀，掩码之外的位被忽略
+ * @param len 前缀长度
+ * @return int 成功为0，没有该路由时为-1
+ */
+int route_delete(uint8_t *prefix, uint8_t len)
+{
+    if (len > 32)
+        return -1;
+    uint32_t addr = route_addr(prefix) & route_mask(len);
+    route_key_t key;
+    route_key(&key, addr, len);
+    uint16_t *rule = map_get(&route_rules, &key);
+    if (rule == NULL)
+        return -1;
+    uint16_t old = *rule;
+    map_delete(&route_rules, &key);
+    uint16_t value = 0;
+    uint8_t depth = 0;
+    // 长于/8的前缀只由同样长于/8的前缀接管，更短的前缀在短前缀表中，表项为0时自然查到
+    for (int l = len - 1; l >= (len > ROUTE_SHORT_MAX ? ROUTE_SHORT_MAX + 1 : 0); l--)
+    {
+        route_key(&key, addr, l);
+        if ((rule = map_get(&route_rules, &key)))
+        {
+            value = *rule, depth = l;
+            break;
+        }
+    }
+    route_paint(addr, len, value, depth, 1); // 只改写已有的项，不会分配二级表
+    route_nhs[old - 1].refs--;
+    arp_generation++;
+    return 0;
+}
+
+/**
+ * @brief 获取路由条数
+ *
+ * @return size_t 路由条数
+ */
+size_t route_size()
+{
+    return map_size(&route_rules);
+}
+
+/**
+ * @brief 初始化路由表，重新初始化时清空原有的路由
+ *
+ */
+void route_init()
+{
+    free(route_tbl24);
+    free(route_tbl24_depth);
+    free(route_tbl8);
+    free(route_tbl8_depth);
+    free(route_tbl8_free);
+    free(route_nhs);
+    route_tbl24 = route_tbl8 = route_tbl8_free = NULL;
+    route_tbl24_depth = route_tbl8_depth = NULL;
+    route_nhs = NULL;
+    route_tbl8_groups = route_tbl8_free_count = route_nh_count = 0;
+    memset(route_short, 0, sizeof(route_short));
+    memset(route_short_depth, 0, sizeof(route_short_depth));
+    map_init(&route_rules, sizeof(route_key_t), sizeof(uint16_t), 0, 0, NULL, NULL);
+}
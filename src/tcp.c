@@ -3,6 +3,8 @@
 #include "tcp.h"
 #include "ip.h"
 #include "icmp.h"
+#include "arp.h"
+#include "checksum.h"
 
 static void panic(const char* msg, int line) {
     printf("panic %s! at line %d\n", msg, line);
@@ -28,7 +30,8 @@ static map_t tcp_table; //tcp_table里面放了一个dst_port的回调函数
 // tcp_key_t[IP, src port, dst port] -> tcp_connect_t
 
 /* Connect_table放置了一堆TCP连接，
-    KEY为[IP，src port，dst port], 即tcp_key_t，VALUE为tcp_connect_t。
+    KEY为[IP，src port，dst port], 即tcp_key_t，VALUE为指向堆上tcp_connect_t的指针。
+    map在增删时会搬移条目，连接对象单独分配以保证应用层持有的指针一直有效。
 */
 static map_t connect_table; 
 
@@ -54,8 +57,8 @@ static tcp_key_t new_tcp_key(uint8_t ip[NET_IP_LEN], uint16_t src_port, uint16_t
  *
  */
 void tcp_init() {
-    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_handler_t), 0, 0, NULL);
-    map_init(&connect_table, sizeof(tcp_key_t), sizeof(tcp_connect_t), 0, 0, NULL);
+    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_handler_t), 0, 0, NULL, NULL);
+    map_init(&connect_table, sizeof(tcp_key_t), sizeof(tcp_connect_t *), 0, 0, NULL, NULL);
     net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
 }
 
@@ -80,11 +83,13 @@ int tcp_open(uint16_t port, tcp_handler_t handler) {
  */
 static void init_tcp_connect_rcvd(tcp_connect_t* connect) {
     if (connect->state == TCP_LISTEN) {
-        connect->rx_buf = malloc(sizeof(buf_t));
-        connect->tx_buf = malloc(sizeof(buf_t));
+        connect->rx_buf = calloc(1, sizeof(buf_t));
+        connect->tx_buf = calloc(1, sizeof(buf_t));
     }
-    buf_init(connect->rx_buf, 0);
-    buf_init(connect->tx_buf, 0);
+    buf_alloc(connect->rx_buf, BUF_MAX_LEN / 2);
+    buf_alloc(connect->tx_buf, BUF_MAX_LEN / 2);
+    connect->tx_sum = connect->tx_sum_off = connect->tx_sum_len = 0;
+    connect->nh.gen = 0;
     connect->state = TCP_SYN_RCVD;
 }
 
@@ -97,24 +102,70 @@ static void init_tcp_connect_rcvd(tcp_connect_t* connect) {
 static void release_tcp_connect(tcp_connect_t* connect) {
     if (connect->state == TCP_LISTEN)
         return;
+    buf_free(connect->rx_buf);
+    buf_free(connect->tx_buf);
     free(connect->rx_buf);
     free(connect->tx_buf);
     connect->state = TCP_LISTEN;
 }
 
+/**
+ * @brief 引用发送缓存中待发送数据的负载段，一个足够单线程使用
+ *
+ */
+static buf_t tx_seg;
+
+/**
+ * @brief tx_seg的反码和，由tcp_write_to_buf从发送缓存的缓存值得到，tx_seg_sum_valid为0时需要重新计算
+ *
+ */
+static uint16_t tx_seg_sum;
+static int tx_seg_sum_valid;
+
+/**
+ * @brief 收到的负载在校验时已拷贝到接收缓存末尾的位置，tcp_read_from_buf据此省去第二次拷贝
+ *
+ */
+static const uint8_t* rx_stage_src;
+static uint8_t* rx_stage_dst;
+
+/**
+ * @brief 计算TCP校验和的反码和部分(未取反)，负载段是tx_seg且已知反码和时不再读取负载
+ *
+ * @param buf TCP首部所在的第一段
+ * @param len 整个报文的长度
+ * @param src_ip,dst_ip 伪头部的地址
+ * @param stage 非NULL时，首部之后的负载(包括重组的数据报的后续段)在求和的同时依次拷贝到这里
+ * @return uint16_t 反码和
+ */
+static uint16_t tcp_sum(buf_t* buf, size_t len, uint8_t* src_ip, uint8_t* dst_ip, uint8_t* stage) {
+    tcp_peso_hdr_t peso_hdr; //伪头部单独求和，不改写包前的空间
+    memcpy(peso_hdr.src_ip, src_ip, NET_IP_LEN);
+    memcpy(peso_hdr.dst_ip, dst_ip, NET_IP_LEN);
+    peso_hdr.placeholder = 0;
+    peso_hdr.protocol = NET_PROTOCOL_TCP;
+    peso_hdr.total_len16 = swap16((uint16_t)len);
+    uint16_t sum = checksum_sum16(&peso_hdr, sizeof(tcp_peso_hdr_t));
+    size_t offset = sizeof(tcp_peso_hdr_t);
+    if (stage) {
+        sum = checksum_combine(sum, checksum_sum16(buf->data, sizeof(tcp_hdr_t)), offset);
+        offset += sizeof(tcp_hdr_t);
+        size_t skip = sizeof(tcp_hdr_t);
+        for (; buf; offset += buf->len - skip, stage += buf->len - skip, buf = buf->next, skip = 0)
+            sum = checksum_combine(sum, checksum_copy16(stage, buf->data + skip, buf->len - skip), offset);
+        return sum;
+    }
+    for (; buf; offset += buf->len, buf = buf->next) {
+        if (buf == &tx_seg && tx_seg_sum_valid)
+            sum = checksum_combine(sum, tx_seg_sum, offset);
+        else
+            sum = checksum_combine(sum, checksum_sum16(buf->data, buf->len), offset);
+    }
+    return sum;
+}
+
 static uint16_t tcp_checksum(buf_t* buf, uint8_t* src_ip, uint8_t* dst_ip) {
-    uint16_t len = (uint16_t)buf->len;
-    tcp_peso_hdr_t* peso_hdr = (tcp_peso_hdr_t*)(buf->data - sizeof(tcp_peso_hdr_t));
-    tcp_peso_hdr_t pre; //暂存被覆盖的IP头
-    memcpy(&pre, peso_hdr, sizeof(tcp_peso_hdr_t));
-    memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN);
-    memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN);
-    peso_hdr->placeholder = 0;
-    peso_hdr->protocol = NET_PROTOCOL_TCP;
-    peso_hdr->total_len16 = swap16(len);
-    uint16_t checksum = checksum16((uint16_t*)peso_hdr, len + sizeof(tcp_peso_hdr_t));
-    memcpy(peso_hdr, &pre, sizeof(tcp_peso_hdr_t));
-    return checksum;
+    return ~tcp_sum(buf, buf_chain_len(buf), src_ip, dst_ip, NULL);
 }
 
 static _Thread_local uint16_t delete_port;
@@ -126,7 +177,7 @@ static _Thread_local uint16_t delete_port;
  */
 static void close_port_fn(void* key, void* value, time_t* timestamp) {
     tcp_key_t* tcp_key = key;
-    tcp_connect_t* connect = value;
+    tcp_connect_t* connect = *(tcp_connect_t**)value;
     if (tcp_key->dst_port == delete_port) {
         release_tcp_connect(connect);
     }
@@ -146,6 +197,7 @@ void tcp_close(uint16_t port) {
 
 /**
  * @brief 从 buf 中读取数据到 connect->rx_buf
+ *        重组的数据报是分片链，各段直接拷贝到rx_buf末尾，不先合并
  *
  * @param connect
  * @param buf
@@ -153,15 +205,23 @@ void tcp_close(uint16_t port) {
  */
 static uint16_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf) {
     uint8_t* dst = connect->rx_buf->data + connect->rx_buf->len;
-    buf_add_padding(connect->rx_buf, buf->len);
-    memcpy(dst, buf->data, buf->len);
-    connect->ack += buf->len;
-    printf("read from buf: %d\n", buf->len);
-    return buf->len;
+    size_t len = buf_chain_len(buf);
+    if (dst == rx_stage_dst && buf->data == rx_stage_src) { // 负载已在校验时拷贝过来，只需计入长度
+        connect->rx_buf->len += len;
+    } else {
+        buf_add_padding(connect->rx_buf, len);
+        buf_gather(buf, dst, len);
+    }
+    rx_stage_dst = NULL;
+    connect->ack += len;
+    printf("read from buf: %d\n", len);
+    return len;
 }
 
 /**
- * @brief 把connect内tx_buf的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ * @brief 把connect内tx_buf的待发送数据作为负载段挂到buf后面供tcp_send使用，buf原来的内容会无效。
+ *        负载不做拷贝，发送前tx_buf不能被修改。一次至多取出一个按路径MTU限制的报文段，发出时不需分片。
+ *        报文段不超过对端窗口中尚未被在途数据占用的部分，窗口用尽时返回0。
  *
  * @param connect
  * @param buf
@@ -169,10 +229,23 @@ static uint16_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf) {
  */
 static uint16_t tcp_write_to_buf(tcp_connect_t* connect, buf_t* buf) {
     uint16_t sent = connect->next_seq - connect->unack_seq;
-    uint16_t size = min32(connect->tx_buf->len - sent, connect->remote_win);
-    buf_init(buf, size);
-    memcpy(buf->data, connect->tx_buf->data + sent, size);
+    uint16_t mss = ip_path_mtu(connect->ip) - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t);
+    // 对端窗口从unack_seq算起，已发出未确认的数据占用其中一部分
+    uint16_t win = connect->remote_win > sent ? connect->remote_win - sent : 0;
+    uint16_t size = min32(min32(connect->tx_buf->len - sent, win), mss);
+    buf_init(buf, 0);
+    buf_init_ref(&tx_seg, connect->tx_buf->data + sent, size);
+    buf->next = &tx_seg;
     connect->next_seq += size;
+    // 待发送数据的反码和已在写入时算好，整段发出时直接使用，只发出一部分时剩余部分的反码和相减得到
+    tx_seg_sum_valid = connect->tx_sum_off == sent && connect->tx_sum_len == connect->tx_buf->len - sent;
+    if (tx_seg_sum_valid) {
+        tx_seg_sum = size == connect->tx_sum_len ? connect->tx_sum : checksum_sum16(tx_seg.data, size);
+        uint16_t rest = checksum_combine(connect->tx_sum, ~tx_seg_sum, 0);
+        connect->tx_sum = checksum_combine(0, rest, size); // 剩余部分从奇数偏移开始时高低字节对调
+        connect->tx_sum_off += size;
+        connect->tx_sum_len -= size;
+    }
     return size;
 }
 
@@ -185,9 +258,9 @@ static uint16_t tcp_write_to_buf(tcp_connect_t* connect, buf_t* buf) {
  * @param flags
  */
 static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
-    printf("<< tcp send >> sz=%zu\n", buf->len);
+    size_t prev_len = buf_chain_len(buf);
+    printf("<< tcp send >> sz=%zu\n", prev_len);
     display_flags(flags);
-    size_t prev_len = buf->len;
     buf_add_header(buf, sizeof(tcp_hdr_t));
     tcp_hdr_t* hdr = (tcp_hdr_t*)buf->data;
     hdr->src_port16 = swap16(connect->local_port);
@@ -200,13 +273,24 @@ static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
     hdr->window_size16 = swap16(connect->remote_win);
     hdr->chunksum16 = 0;
     hdr->urgent_pointer16 = 0;
-    hdr->chunksum16 = tcp_checksum(buf, connect->ip, net_if_ip);
-    ip_out(buf, connect->ip, NET_PROTOCOL_TCP);
+    hdr->chunksum16 = tcp_checksum(buf, connect->ip, ip_source(connect->ip));
+    ip_out_cached(buf, connect->ip, NET_PROTOCOL_TCP, &connect->nh);
     if (flags.syn || flags.fin) {
         connect->next_seq += 1;
     }
 }
 
+/**
+ * @brief 把tx_buf中的待发送数据逐个报文段带上ACK发出，直到发完或用尽对端窗口
+ *
+ * @param connect
+ * @param buf 用于组装报文段，原来的内容会无效
+ */
+static void tcp_send_pending(tcp_connect_t* connect, buf_t* buf) {
+    while (tcp_write_to_buf(connect, buf))
+        tcp_send(buf, connect, tcp_flags_ack);
+}
+
 /**
  * @brief 从外部关闭一个TCP连接, 会发送剩余数据
  *        供应用层使用
@@ -215,7 +299,7 @@ static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
  */
 void tcp_connect_close(tcp_connect_t* connect) {
     if (connect->state == TCP_ESTABLISHED) {
-        tcp_write_to_buf(connect, &txbuf);
+        tcp_send_pending(connect, &txbuf); // 剩余数据发完后txbuf是空的报文段，带上FIN发出
         tcp_send(&txbuf, connect, tcp_flags_ack_fin);
         connect->state = TCP_FIN_WAIT_1;
         return;
@@ -223,6 +307,7 @@ void tcp_connect_close(tcp_connect_t* connect) {
     tcp_key_t key = new_tcp_key(connect->ip, connect->remote_port, connect->local_port);
     release_tcp_connect(connect);
     map_delete(&connect_table, &key);
+    free(connect);
 }
 
 /**
@@ -258,20 +343,29 @@ size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len
     buf_t* tx_buf = connect->tx_buf;
 
     uint8_t* dst = tx_buf->data + tx_buf->len;
-    size_t size = min32(&tx_buf->payload[BUF_MAX_LEN] - dst, len);
+    size_t size = min32(tx_buf->payload + tx_buf->size - dst, len);
 
     if (connect->next_seq - connect->unack_seq + len >= connect->remote_win) {
         return 0;
     }
+    uint32_t sent = connect->next_seq - connect->unack_seq, pending = tx_buf->len - sent;
     if (buf_add_padding(tx_buf, size) != 0) {
         memmove(tx_buf->payload, tx_buf->data, tx_buf->len);
         tx_buf->data = tx_buf->payload;
-        if (tcp_write_to_buf(connect, &txbuf)) {
-            tcp_send(&txbuf, connect, tcp_flags_ack);
-        }
+        tcp_send_pending(connect, &txbuf);
         return 0;
     }
-    memcpy(dst, data, size);
+    // 拷贝的同时累加待发送数据的反码和，发送时不必再读一遍
+    if (pending == 0) {
+        connect->tx_sum = 0;
+        connect->tx_sum_off = sent;
+        connect->tx_sum_len = 0;
+    }
+    uint16_t sum = checksum_copy16(dst, data, size);
+    if (connect->tx_sum_off == sent && connect->tx_sum_len == pending) {
+        connect->tx_sum = checksum_combine(connect->tx_sum, sum, pending);
+        connect->tx_sum_len += size;
+    }
     return size;
 }
 
@@ -286,6 +380,7 @@ void reset_tcp(tcp_connect_t *connect, uint32_t get_seq) {
 void close_tcp(tcp_connect_t *connect, tcp_key_t *key) {
     release_tcp_connect(connect);
     map_delete(&connect_table, key);
+    free(connect);
     return;
 }
 
@@ -303,6 +398,9 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     1、大小检查，检查buf长度是否小于tcp头部，如果是，则丢弃
     */
 
+   // 重组的数据报是分片链，只在第一段放不下TCP首部时才合并
+   if (buf->next && buf->len < sizeof(tcp_hdr_t) && buf_linearize(buf) == -1)
+        return;
    if (buf->len < sizeof(tcp_hdr_t)) {
         printf("buf for tcp_in too short\n");
         return;
@@ -313,11 +411,22 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     */
 
     tcp_hdr_t *tcph = (tcp_hdr_t *)buf->data;
-    uint16_t origin_checksum = tcph->chunksum16;
-    tcph->chunksum16 = 0;
-    tcph->chunksum16 = tcp_checksum(buf, src_ip, net_if_ip);
-    if (tcph->chunksum16 != origin_checksum) {
+    tcp_key_t key = new_tcp_key(src_ip, swap16(tcph->src_port16), swap16(tcph->dst_port16));
+    tcp_connect_t** slot = (tcp_connect_t **)map_get(&connect_table, &key);
+    // 已建立的连接在校验的同时把负载拷贝到接收缓存末尾，负载只读一遍；驱动已确认过的不再计算
+    rx_stage_dst = NULL;
+    int verified = buf->csum_flags & BUF_CSUM_L4_VALID;
+    size_t seg_len = buf_chain_len(buf);
+    if (!verified && slot && (*slot)->state == TCP_ESTABLISHED && seg_len > sizeof(tcp_hdr_t)) {
+        buf_t* rx_buf = (*slot)->rx_buf;
+        if (rx_buf->data + rx_buf->len + seg_len - sizeof(tcp_hdr_t) <= rx_buf->payload + rx_buf->size) {
+            rx_stage_dst = rx_buf->data + rx_buf->len;
+            rx_stage_src = buf->data + sizeof(tcp_hdr_t);
+        }
+    }
+    if (!verified && (uint16_t)~tcp_sum(buf, seg_len, src_ip, net_ifs[buf->if_index].ip, rx_stage_dst)) { // 连同校验和字段一起求和，正确时结果为0
         printf("tcp_in checksum failed\n");
+        rx_stage_dst = NULL;
         return;
     }
 
@@ -347,18 +456,17 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     5、调用new_tcp_key函数，根据通信五元组中的源IP地址、源端口号、目标端口号确定一个tcp链接key
     */
 
-    tcp_key_t key = new_tcp_key(src_ip, src_port16, dst_port16);
+    // key和slot已在校验时查好
 
     /*
     6、调用map_get函数，根据key查找一个tcp_connect_t* connect，
     如果没有找到，则调用map_set建立新的链接，并设置为CONNECT_LISTEN状态，然后调用mag_get获取到该链接。
     */
-    tcp_connect_t* connect = (tcp_connect_t *)map_get(&connect_table, &key);
+    tcp_connect_t* connect = slot ? *slot : NULL;
     if (!connect) {
         connect = (tcp_connect_t *)malloc(sizeof(tcp_connect_t));
         *connect = CONNECT_LISTEN;
-        map_set(&connect_table, &key, connect);
-        connect = (tcp_connect_t *)map_get(&connect_table, &key);
+        map_set(&connect_table, &key, &connect);
     }
 
     /*
@@ -383,8 +491,10 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     */
 
     if (connect->state == TCP_LISTEN) {
-        if (flags.rst) 
+        if (flags.rst) {
             close_tcp(connect, &key);
+            return;
+        }
         if (!flags.syn) 
             reset_tcp(connect, seq_num32);
         init_tcp_connect_rcvd(connect);
@@ -413,8 +523,14 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     10、检查flags是否有rst标志，如果有，则close_tcp连接重置
     */
 
-    if (flags.rst)
+    if (flags.rst) {
         close_tcp(connect, &key);
+        return;
+    }
+
+    // 确认了新数据的ACK说明对端可达，提示邻居缓存延长可达时间
+    if (flags.ack && connect->unack_seq < ack_num32 && ack_num32 <= connect->next_seq)
+        arp_confirm(src_ip);
 
     /*
     11、序号相同时的处理，调用buf_remove_header去除头部后剩下的都是数据
@@ -500,15 +616,13 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
             break;
         }
 
-        if (buf->len) {
+        if (buf->len || buf->next) {
             tcp_send(&txbuf, connect, tcp_flags_ack);
             (*handler)(connect, TCP_ESTABLISHED);
         }
         if (connect->unack_seq > connect->next_seq) 
             printf("panic here!\n");
-        tcp_write_to_buf(connect, buf);
-        if (buf->len) 
-            tcp_send(buf, connect, tcp_flags_ack);
+        tcp_send_pending(connect, buf);
         break;
 
     case TCP_CLOSE_WAIT:
@@ -0,0 +1,228 @@
+#include <stddef.h>
+#include "timer.h"
+#include "clock.h"
+
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+#if TIMER_WHEEL_BITS > 6
+#error "TIMER_WHEEL_BITS must fit the 64-bit slot bitmap"
+#endif
+
+/**
+ * @brief 分层时间轮，第n层的每个槽跨越TIMER_WHEEL_SLOTS^n个刻度
+ *
+ */
+static net_timer_t *timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+/**
+ * @brief 每层非空槽的位图，用于直接跳到下一个需要处理的刻度
+ *
+ */
+static uint64_t timer_bitmap[TIMER_WHEEL_LEVELS];
+
+/**
+ * @brief 时间轮当前走到的刻度
+ *
+ */
+static uint64_t timer_tick;
+
+/**
+ * @brief 挂在时间轮上的定时器数量
+ *
+ */
+static size_t timer_count;
+
+/**
+ * @brief 内部函数，把定时器挂到到期刻度对应的层和槽上
+ *
+ * @param timer 要挂载的定时器
+ */
+static void timer_link(net_timer_t *timer)
+{
+    int level, index = -1;
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        int shift = level * TIMER_WHEEL_BITS;
+        if ((timer->expire >> shift) - (timer_tick >> shift) < TIMER_WHEEL_SLOTS)
+        {
+            index = (timer->expire >> shift) & TIMER_WHEEL_MASK;
+            break;
+        }
+    }
+    if (index < 0) // 超出最高层的范围，先放在最高层最远的槽里，级联时再重新安置
+    {
+        level = TIMER_WHEEL_LEVELS - 1;
+        index = ((timer_tick >> (level * TIMER_WHEEL_BITS)) - 1) & TIMER_WHEEL_MASK;
+    }
+    net_timer_t **slot = &timer_wheel[level][index];
+    timer->next = *slot;
+    if (*slot)
+        (*slot)->pprev = &timer->next;
+    *slot = timer;
+    timer->pprev = slot;
+    timer->slot = level << TIMER_WHEEL_BITS | index;
+    timer_bitmap[level] |= 1ull << index;
+    timer_count++;
+}
+
+/**
+ * @brief 内部函数，把定时器从时间轮上摘下
+ *
+ * @param timer 要摘下的定时器
+ */
+static void timer_unlink(net_timer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    int level = timer->slot >> TIMER_WHEEL_BITS, index = timer->slot & TIMER_WHEEL_MASK;
+    if (timer_wheel[level][index] == NULL)
+        timer_bitmap[level] &= ~(1ull << index);
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer_count--;
+}
+
+/**
+ * @brief 内部函数，把高层一个槽中的定时器重新安置到更低的层
+ *
+ * @param level 层号
+ * @param index 槽号
+ */
+static void timer_cascade(int level, size_t index)
+{
+    net_timer_t *timer = timer_wheel[level][index];
+    timer_wheel[level][index] = NULL;
+    timer_bitmap[level] &= ~(1ull << index);
+    while (timer)
+    {
+        net_timer_t *next = timer->next;
+        timer_count--;
+        timer_link(timer);
+        timer = next;
+    }
+}
+
+/**
+ * @brief 内部函数，计算下一个需要处理(到期或级联)的刻度
+ *
+ * @return uint64_t 刻度，时间轮为空时为UINT64_MAX
+ */
+static uint64_t timer_next_tick()
+{
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        if (!timer_bitmap[level])
+            continue;
+        int shift = level * TIMER_WHEEL_BITS;
+        uint64_t round = timer_tick >> shift >> TIMER_WHEEL_BITS;
+        int current = (timer_tick >> shift) & TIMER_WHEEL_MASK;
+        // 本圈中当前槽之后的槽，否则是下一圈
+        uint64_t later = current == TIMER_WHEEL_MASK ? 0 : timer_bitmap[level] & (~0ull << (current + 1));
+        uint64_t bits = later ? later : timer_bitmap[level];
+        if (!later)
+            round++;
+        uint64_t tick = ((round << TIMER_WHEEL_BITS) | __builtin_ctzll(bits)) << shift;
+        if (tick < next)
+            next = tick;
+    }
+    return next;
+}
+
+/**
+ * @brief 初始化时间轮，从当前协议栈时钟开始计时
+ *
+ */
+void timer_init()
+{
+    timer_tick = clock_now_ms() / TIMER_TICK_MS;
+}
+
+/**
+ * @brief 初始化一个定时器
+ *
+ * @param timer 要初始化的定时器
+ * @param handler 到期回调
+ * @param arg 回调参数
+ */
+void timer_setup(net_timer_t *timer, timer_handler_t handler, void *arg)
+{
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expire = 0;
+    timer->slot = 0;
+    timer->handler = handler;
+    timer->arg = arg;
+}
+
+/**
+ * @brief 启动定时器，若已启动则重新计时，O(1)
+ *
+ * @param timer 要启动的定时器
+ * @param delay_ms 多少毫秒后到期
+ */
+void timer_arm(net_timer_t *timer, uint64_t delay_ms)
+{
+    if (timer_pending(timer))
+        timer_unlink(timer);
+    uint64_t expire = (clock_now_ms() + delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    timer->expire = expire > timer_tick ? expire : timer_tick + 1;
+    timer_link(timer);
+}
+
+/**
+ * @brief 取消定时器，O(1)
+ *
+ * @param timer 要取消的定时器
+ */
+void timer_cancel(net_timer_t *timer)
+{
+    if (timer_pending(timer))
+        timer_unlink(timer);
+}
+
+/**
+ * @brief 把时间轮推进到当前协议栈时钟，依次执行到期的定时器
+ *        中间没有定时器的刻度直接跳过
+ *
+ */
+void timer_poll()
+{
+    uint64_t target = clock_now_ms() / TIMER_TICK_MS;
+    while (timer_tick < target)
+    {
+        uint64_t next = timer_next_tick();
+        if (next > target)
+        {
+            timer_tick = target;
+            break;
+        }
+        timer_tick = next;
+        // 走到高层槽的边界时，把该槽级联到低层
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+            if (!(timer_tick & ((1ull << (level * TIMER_WHEEL_BITS)) - 1)))
+                timer_cascade(level, (timer_tick >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+
+        net_timer_t **slot = &timer_wheel[0][timer_tick & TIMER_WHEEL_MASK];
+        while (*slot)
+        {
+            net_timer_t *timer = *slot;
+            timer_unlink(timer);
+            timer->handler(timer->arg); // 回调中可以重新启动或取消任意定时器
+        }
+    }
+}
+
+/**
+ * @brief 查询最早到期的定时器的到期时间，用于空闲时决定可以等待多久
+ *        高层的定时器返回其级联的时刻，不晚于实际到期时间
+ *
+ * @return uint64_t 毫秒时间戳，没有定时器时为UINT64_MAX
+ */
+uint64_t timer_next_expire()
+{
+    uint64_t next = timer_next_tick();
+    return next == UINT64_MAX ? UINT64_MAX : next * TIMER_TICK_MS;
+}
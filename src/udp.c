@@ -1,6 +1,7 @@
 #include "udp.h"
 #include "ip.h"
 #include "icmp.h"
+#include "checksum.h"
 
 /**
  * @brief udp处理程序表
@@ -8,6 +9,26 @@
  */
 map_t udp_table;
 
+/**
+ * @brief 计算udp伪头部的反码和(未取反)
+ * 
+ * @param len udp报文长度
+ * @param src_ip 源ip地址
+ * @param dst_ip 目的ip地址
+ * @return uint16_t 伪头部的反码和
+ */
+static uint16_t udp_peso_sum(size_t len, uint8_t *src_ip, uint8_t *dst_ip)
+{
+    // 伪头部单独求和，不占用也不改写包前的空间，接收的包可以直接指向网卡帧
+    udp_peso_hdr_t uph;
+    memmove(uph.dst_ip, dst_ip, NET_IP_LEN);
+    memmove(uph.src_ip, src_ip, NET_IP_LEN);
+    uph.placeholder = 0;
+    uph.protocol = NET_PROTOCOL_UDP;
+    uph.total_len16 = swap16(len);
+    return checksum_sum16(&uph, sizeof(udp_peso_hdr_t));
+}
+
 /**
  * @brief udp伪校验和计算
  * 
@@ -19,29 +40,8 @@ map_t udp_table;
 static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip)
 {
     // TO-DO
-    uint16_t len = swap16(buf->len);
-
-    buf_add_header(buf, sizeof(udp_peso_hdr_t));
-    
-    udp_peso_hdr_t *uph = (udp_peso_hdr_t *)buf->data;
-    udp_peso_hdr_t tmp = *uph;
-    memmove(uph->dst_ip, dst_ip, NET_IP_LEN);
-    memmove(uph->src_ip, src_ip, NET_IP_LEN);
-    uph->placeholder = 0;
-    uph->protocol = NET_PROTOCOL_UDP;
-    uph->total_len16 = len;
-
-    size_t padding_len = buf->len % 2;
-    buf_add_padding(buf, padding_len);
-    
-    uint16_t checksum = checksum16((uint16_t *)buf->data, buf->len);
-    
-    buf_remove_padding(buf, padding_len);
-
-    *uph = tmp;
-    buf_remove_header(buf, sizeof(udp_peso_hdr_t));
-
-    return checksum;
+    uint16_t sum = udp_peso_sum(buf_chain_len(buf), src_ip, dst_ip);
+    return ~checksum_combine(sum, ~buf_checksum16(buf), sizeof(udp_peso_hdr_t));
 }
 
 /**
@@ -59,10 +59,8 @@ void udp_in(buf_t *buf, uint8_t *src_ip)
     }
 
     udp_hdr_t *uh = (udp_hdr_t *)buf->data;
-    uint16_t origin_checksum16 = uh->checksum16;
-    uh->checksum16 = 0;
-    uh->checksum16 = udp_checksum(buf, src_ip, net_if_ip);
-    if (origin_checksum16 != uh->checksum16) {
+    // 连同校验和字段一起求和，正确时结果为0；驱动已确认过的不再计算
+    if (!(buf->csum_flags & BUF_CSUM_L4_VALID) && udp_checksum(buf, src_ip, net_ifs[buf->if_index].ip)) {
         printf("udp_in checksum failed\n");
         return;
     }
@@ -71,6 +69,8 @@ void udp_in(buf_t *buf, uint8_t *src_ip)
     udp_handler_t *handler = (udp_handler_t *)map_get(&udp_table, &dst_port16);
 
     if (handler) {
+        if (buf->next && buf_linearize(buf) == -1) // 重组的数据报是分片链，处理程序需要连续的数据
+            return;
         buf_remove_header(buf, sizeof(udp_hdr_t));
         (*handler)(buf->data, buf->len, src_ip, dst_port16);
         return;
@@ -95,28 +95,40 @@ void udp_in(buf_t *buf, uint8_t *src_ip)
 }
 
 /**
- * @brief 处理一个要发送的数据包
+ * @brief 内部函数，加上udp头部后经由给定的下一跳缓存发送
  * 
  * @param buf 要处理的包
  * @param src_port 源端口号
  * @param dst_ip 目的ip地址
  * @param dst_port 目的端口号
+ * @param nh 下一跳缓存，为NULL时查arp表
  */
-void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+static void udp_out_cached(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port, arp_cache_t *nh)
 {
-    // TO-DO
-    // ip_hdr_t *iph = (ip_hdr_t *)buf->data;
-    // protocol = iph->protocol;
-    
     buf_add_header(buf, sizeof(udp_hdr_t));
     udp_hdr_t *uh = (udp_hdr_t *)buf->data;
     uh->dst_port16 = swap16(dst_port);
     uh->src_port16 = swap16(src_port);
     uh->checksum16 = 0;
-    uh->total_len16 = swap16(buf->len);
+    uh->total_len16 = swap16(buf_chain_len(buf));
 
-    uh->checksum16 = udp_checksum(buf, net_if_ip, dst_ip);
-    ip_out(buf, dst_ip, NET_PROTOCOL_UDP);
+    // 负载的校验和留到驱动聚集数据时随拷贝一起算出
+    buf_csum_partial(buf, 0, offsetof(udp_hdr_t, checksum16), udp_peso_sum(buf_chain_len(buf), ip_source(dst_ip), dst_ip));
+    ip_out_cached(buf, dst_ip, NET_PROTOCOL_UDP, nh);
+}
+
+/**
+ * @brief 处理一个要发送的数据包
+ * 
+ * @param buf 要处理的包
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ */
+void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    // TO-DO
+    udp_out_cached(buf, src_port, dst_ip, dst_port, NULL);
 }
 
 /**
@@ -125,7 +137,7 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
  */
 void udp_init()
 {
-    map_init(&udp_table, sizeof(uint16_t), sizeof(udp_handler_t), 0, 0, NULL);
+    map_init(&udp_table, sizeof(uint16_t), sizeof(udp_handler_t), 0, 0, NULL, NULL);
     net_add_protocol(NET_PROTOCOL_UDP, udp_in);
 }
 
@@ -162,7 +174,44 @@ void udp_close(uint16_t port)
  */
 void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
 {
-    buf_init(&txbuf, len);
-    memcpy(txbuf.data, data, len);
+    // 数据留在原处作为负载段，txbuf只用来装载协议头
+    buf_t payload;
+    buf_init(&txbuf, 0);
+    buf_init_ref(&payload, data, len);
+    txbuf.next = &payload;
     udp_out(&txbuf, src_port, dst_ip, dst_port);
+    txbuf.next = NULL; // 负载段在栈上，返回前从txbuf摘下
+}
+
+/**
+ * @brief 初始化一个udp发送上下文
+ * 
+ * @param flow 发送上下文
+ * @param src_port 源端口号
+ * @param dst_ip 目的ip地址
+ * @param dst_port 目的端口号
+ */
+void udp_flow_init(udp_flow_t *flow, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    flow->src_port = src_port;
+    flow->dst_port = dst_port;
+    memcpy(flow->dst_ip, dst_ip, NET_IP_LEN);
+    flow->nh.gen = 0;
+}
+
+/**
+ * @brief 经由发送上下文发送一个udp包，下一跳有效时不查arp表
+ * 
+ * @param flow 发送上下文
+ * @param data 要发送的数据
+ * @param len 数据长度
+ */
+void udp_flow_send(udp_flow_t *flow, uint8_t *data, uint16_t len)
+{
+    buf_t payload;
+    buf_init(&txbuf, 0);
+    buf_init_ref(&payload, data, len);
+    txbuf.next = &payload;
+    udp_out_cached(&txbuf, flow->src_port, flow->dst_ip, flow->dst_port, &flow->nh);
+    txbuf.next = NULL;
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "checksum.h"
 #include <stdio.h>
 #include <string.h>
 /**
@@ -78,21 +79,5 @@ uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb)
 uint16_t checksum16(uint16_t *data, size_t len)
 {
     // TO-DO
-    uint16_t chksum;
-	uint32_t sum = 0;
- 
-	while(len > 1)
-	{
-		sum += *data++;
-		len -= 2;
-	}
-	
-	if(len == 1)
-		sum += *(uint8_t *)data;
-		
-    while (sum >> 16 != 0) 
-	    sum = (sum>>16) + (sum & 0xffff);
-	// sum += (sum>>16);
-	chksum = ~(sum & 0xffff);
-	return chksum;
+    return ~checksum_sum16(data, len); // 按CPU选择向量化实现，结果与逐字累加相同
 }
\ No newline at end of file
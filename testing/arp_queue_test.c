@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "arp.h"
+#include "ip.h"
+#include "clock.h"
+#include "timer.h"
+#include "driver.h"
+#include "test.h"
+
+extern map_t arp_buf;
+extern map_t arp_table;
+
+/**
+ * @brief 向arp_out送入n个长度为len的数据包
+ */
+static void send_to(uint8_t *ip, int n, size_t len)
+{
+        buf_t buf = {0};
+        for(int i = 0; i < n; i++){
+                buf_init(&buf, len);
+                memset(buf.data, i, len);
+                arp_out(&buf, ip);
+        }
+        buf_free(&buf);
+}
+
+/**
+ * @brief 推进虚拟时钟并处理到期的定时器
+ */
+static void advance(uint64_t ms)
+{
+        clock_advance(ms + TIMER_TICK_MS);
+        timer_poll();
+}
+
+int main(int argc, char* argv[]){
+        printf("\e[0;34mTest begin.\n");
+        pcap_in = open_file(argv[1], "in.pcap","r");
+        pcap_out = tmpfile();
+        control_flow = ip_fout = arp_log_f = tmpfile();
+        if(pcap_in == 0 || pcap_out == 0 || control_flow == 0){
+                printf("\e[1;31mFailed to open files\n\e[0m");
+                return -1;
+        }
+        net_init();
+
+        // 队列按包数限制，多出的包计为丢弃
+        uint8_t ip_a[] = {192, 168, 163, 20}, mac_a[] = {0x02, 0, 0, 0, 0, 0x20};
+        send_to(ip_a, ARP_PENDING_MAX_PKTS + 2, 100);
+        arp_pending_t *pending = map_get(&arp_buf, ip_a);
+        CHECK(pending && pending->count == ARP_PENDING_MAX_PKTS && pending->bytes == ARP_PENDING_MAX_PKTS * 100);
+        CHECK(arp_stats.queued == ARP_PENDING_MAX_PKTS && arp_stats.drop_full == 2);
+        CHECK(pending && pending->bufs[1].data[0] == 1);
+
+        // 队列按字节数限制
+        uint8_t ip_b[] = {192, 168, 163, 21};
+        send_to(ip_b, 2, ARP_PENDING_MAX_BYTES / 2 + 1);
+        pending = map_get(&arp_buf, ip_b);
+        CHECK(pending && pending->count == 1 && arp_stats.drop_full == 3);
+
+        // 收到响应后按顺序一次发出，之后直接发送
+        ssize_t before = ftell(pcap_out);
+        arp_in(arp_pkt_build(ARP_REPLY, ip_a, mac_a, net_if_ip), mac_a);
+        CHECK(map_get(&arp_buf, ip_a) == NULL && arp_stats.flushed == ARP_PENDING_MAX_PKTS);
+        send_to(ip_a, 1, 100);
+        CHECK(arp_stats.queued == ARP_PENDING_MAX_PKTS + 1);
+        driver_flush();
+        fflush(pcap_out);
+        CHECK(ftell(pcap_out) > before);
+
+        // 等待超时，队列中的包计为超时丢弃
+        advance(ARP_MIN_INTERVAL * 1000 + 1000);
+        CHECK(map_get(&arp_buf, ip_b) == NULL && arp_stats.drop_timeout == 1);
+
+        // 一个最大的数据报按以太网MTU分成的分片可以全部排队，响应后全部发出
+        uint8_t ip_c[] = {192, 168, 163, 22}, mac_c[] = {0x02, 0, 0, 0, 0, 0x22};
+        size_t frag_data = (ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t)) & ~7;
+        int frags = (UINT16_MAX - sizeof(ip_hdr_t) + frag_data - 1) / frag_data;
+        uint64_t drop_full = arp_stats.drop_full, sent = arp_stats.flushed;
+        send_to(ip_c, frags, ETHERNET_MAX_TRANSPORT_UNIT);
+        pending = map_get(&arp_buf, ip_c);
+        CHECK(pending && pending->count == frags && arp_stats.drop_full == drop_full);
+        arp_in(arp_pkt_build(ARP_REPLY, ip_c, mac_c, net_if_ip), mac_c);
+        CHECK(arp_stats.flushed == sent + frags);
+
+        // 邻居状态：可达时间过后被使用转入DELAY，上层确认后回到REACHABLE，不发送探测
+        arp_entry_t *entry = map_get(&arp_table, ip_a);
+        CHECK(entry && entry->state == ARP_REACHABLE && !memcmp(entry->mac, mac_a, NET_MAC_LEN));
+        advance(ARP_REACHABLE_MS);
+        send_to(ip_a, 1, 100);
+        entry = map_get(&arp_table, ip_a);
+        CHECK(entry && entry->state == ARP_DELAY);
+        arp_confirm(ip_a);
+        CHECK(entry->state == ARP_REACHABLE);
+        advance(ARP_DELAY_MS);
+        CHECK(entry->state == ARP_REACHABLE && entry->probes == 0);
+
+        // 没有确认时DELAY到期后单播探测，探测期间照常发送，全部无响应后失效
+        advance(ARP_REACHABLE_MS);
+        send_to(ip_a, 1, 100);
+        advance(ARP_DELAY_MS);
+        entry = map_get(&arp_table, ip_a);
+        CHECK(entry && entry->state == ARP_PROBE && entry->probes == 1);
+        send_to(ip_a, 1, 100);
+        CHECK(map_get(&arp_buf, ip_a) == NULL);
+        for(int i = 1; i < ARP_PROBE_MAX; i++)
+                advance(ARP_PROBE_INTERVAL_MS);
+        CHECK(entry->state == ARP_PROBE && entry->probes == ARP_PROBE_MAX);
+        advance(ARP_PROBE_INTERVAL_MS);
+        CHECK(entry->state == ARP_FAILED);
+
+        // 失效的表项重新广播解析，响应后恢复可达并发出等待的包
+        uint64_t queued = arp_stats.queued, flushed = arp_stats.flushed;
+        send_to(ip_a, 1, 100);
+        CHECK(map_get(&arp_buf, ip_a) != NULL && arp_stats.queued == queued + 1);
+        arp_in(arp_pkt_build(ARP_REPLY, ip_a, mac_a, net_if_ip), mac_a);
+        entry = map_get(&arp_table, ip_a);
+        CHECK(entry && entry->state == ARP_REACHABLE && arp_stats.flushed == flushed + 1);
+
+        // 缓存的下一跳：REACHABLE时填入，mac改变时失效，可达时间过后重新查表推进状态
+        arp_cache_t nh = {0};
+        buf_t buf = {0};
+        buf_init(&buf, 100);
+        arp_out_cached(&buf, ip_a, &nh);
+        CHECK(nh.gen == arp_generation && !memcmp(nh.mac, mac_a, NET_MAC_LEN));
+        uint8_t mac_b[] = {0x02, 0, 0, 0, 0, 0x21};
+        arp_in(arp_pkt_build(ARP_REPLY, ip_a, mac_b, net_if_ip), mac_b);
+        CHECK(nh.gen != arp_generation);
+        buf_init(&buf, 100);
+        arp_out_cached(&buf, ip_a, &nh);
+        CHECK(nh.gen == arp_generation && !memcmp(nh.mac, mac_b, NET_MAC_LEN));
+        advance(ARP_REACHABLE_MS);
+        buf_init(&buf, 100);
+        arp_out_cached(&buf, ip_a, &nh);
+        entry = map_get(&arp_table, ip_a);
+        CHECK(nh.gen == 0 && entry && entry->state == ARP_DELAY);
+        buf_free(&buf);
+
+        driver_close();
+        if (failed) {
+                printf("\e[1;31m====> Arp queue test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Arp queue test passed.\n\e[0m");
+        return 0;
+}
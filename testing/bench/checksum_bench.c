@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "checksum.h"
+
+#define BENCH_BYTES (256ull << 20) //每组测试累计处理的字节数
+
+static const char *impls[] = {"generic", "sse2", "avx2"};
+static const size_t lens[] = {20, 64, 1500, 65536};
+static uint8_t data[65536 + 1];
+
+/**
+ * @brief 旧版checksum16的做法，每次循环累加一个16位字
+ *
+ */
+static uint16_t legacy_sum16(const void *p, size_t len)
+{
+    const uint16_t *w = p;
+    uint32_t sum = 0;
+    while (len > 1)
+    {
+        sum += *w++;
+        len -= 2;
+    }
+    if (len == 1)
+        sum += *(const uint8_t *)w;
+    while (sum >> 16)
+        sum = (sum >> 16) + (sum & 0xffff);
+    return sum;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint8_t copy[65536 + 1];
+
+/**
+ * @brief 拷贝后再求和，每个字节读两次
+ *
+ */
+static uint16_t memcpy_sum16(void *dst, const void *src, size_t len)
+{
+    memcpy(dst, src, len);
+    return checksum_sum16(dst, len);
+}
+
+static void bench_copy(const char *name, checksum_copy_fn_t fn)
+{
+    printf("%-14s", name);
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+    {
+        size_t rounds = BENCH_BYTES / lens[i];
+        volatile uint16_t sink = 0;
+        double start = now_sec();
+        for (size_t r = 0; r < rounds; r++)
+            sink += fn(copy, data + (r & 1), lens[i]);
+        double sec = now_sec() - start;
+        printf("  %6zuB %7.2f GB/s", lens[i], rounds * lens[i] / sec / 1e9);
+    }
+    printf("\n");
+}
+
+static void bench(const char *name, checksum_fn_t fn)
+{
+    printf("%-14s", name);
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+    {
+        size_t rounds = BENCH_BYTES / lens[i];
+        volatile uint16_t sink = 0;
+        double start = now_sec();
+        for (size_t r = 0; r < rounds; r++)
+            sink += fn(data + (r & 1), lens[i]); // 交替使用对齐与不对齐的起始地址
+        double sec = now_sec() - start;
+        printf("  %6zuB %7.2f GB/s", lens[i], rounds * lens[i] / sec / 1e9);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = i * 131 + 7;
+    bench("legacy", legacy_sum16);
+    for (int i = 0; i < 3; i++)
+    {
+        if (checksum_select(impls[i]) == -1)
+        {
+            printf("%-14s  not supported\n", impls[i]);
+            continue;
+        }
+        bench(impls[i], checksum_sum16);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        char name[32];
+        if (checksum_select(impls[i]) == -1)
+            continue;
+        sprintf(name, "%s memcpy", impls[i]);
+        bench_copy(name, memcpy_sum16);
+        sprintf(name, "%s fused", impls[i]);
+        bench_copy(name, checksum_copy16);
+    }
+    checksum_select(NULL);
+    printf("default: %s\n", checksum_selected());
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "route.h"
+#include "driver.h"
+
+#define ROUNDS 200000 //每种场景处理的批数
+#define FRAME_LEN 64  //测试帧长度，最小以太网帧(不含FCS)
+
+/**
+ * @brief 只把帧聚集到发送队列的驱动，代替网卡测量协议栈本身的转发开销
+ *
+ */
+static uint8_t tx_frames[DRIVER_TX_QUEUE_LEN][BUF_BLOCK_LEN];
+static int tx_pending;
+static uint64_t tx_count;
+
+int driver_open(net_if_t *netif) { return 0; }
+int driver_recv(net_if_t *netif, buf_t *buf) { return 0; }
+int driver_recv_burst(net_if_t *netif, buf_t **bufs, int max) { return 0; }
+int driver_send(buf_t *buf)
+{
+    if (buf_gather_csum(buf, tx_frames[tx_pending], BUF_BLOCK_LEN) == 0)
+        return -1;
+    if (++tx_pending == DRIVER_TX_QUEUE_LEN)
+        return driver_flush();
+    return 0;
+}
+int driver_tx_room(net_if_t *netif) { return DRIVER_TX_QUEUE_LEN - tx_pending; }
+int driver_flush()
+{
+    tx_count += tx_pending;
+    tx_pending = 0;
+    return 0;
+}
+int driver_fd(net_if_t *netif) { return -1; }
+void driver_close() {}
+
+static uint8_t peer_mac[] = {0x02, 0, 0, 0, 0, 0x09};
+static uint8_t gw_mac[] = {0x02, 0, 0, 0, 0, 0x01};
+static uint8_t gw_ip[] = {192, 168, 56, 1};
+
+static uint8_t templates[NET_BURST_SIZE][FRAME_LEN];
+static uint8_t frames[NET_BURST_SIZE][BUF_HEADROOM + FRAME_LEN];
+static buf_t bufs[NET_BURST_SIZE];
+static buf_t *vec[NET_BURST_SIZE];
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 模拟收到ip对应的arp响应，使邻居进入可达状态
+ */
+static void resolve(uint8_t *ip, uint8_t *mac)
+{
+    buf_t reply = {0};
+    buf_init(&reply, sizeof(arp_pkt_t));
+    arp_pkt_t *pkt = (arp_pkt_t *)reply.data;
+    pkt->hw_type16 = constswap16(ARP_HW_ETHER);
+    pkt->pro_type16 = constswap16(NET_PROTOCOL_IP);
+    pkt->hw_len = NET_MAC_LEN;
+    pkt->pro_len = NET_IP_LEN;
+    pkt->opcode16 = constswap16(ARP_REPLY);
+    memcpy(pkt->sender_mac, mac, NET_MAC_LEN);
+    memcpy(pkt->sender_ip, ip, NET_IP_LEN);
+    memcpy(pkt->target_mac, net_if_mac, NET_MAC_LEN);
+    memcpy(pkt->target_ip, net_if_ip, NET_IP_LEN);
+    arp_in(&reply, mac);
+    buf_free(&reply);
+}
+
+/**
+ * @brief 生成一批发往a.b.0.0/16中不同地址的帧
+ */
+static void make_templates(uint8_t a, uint8_t b)
+{
+    for (int i = 0; i < NET_BURST_SIZE; i++)
+    {
+        uint8_t *frame = templates[i];
+        memset(frame, 0, FRAME_LEN);
+        ether_hdr_t *eth = (ether_hdr_t *)frame;
+        memcpy(eth->dst, net_if_mac, NET_MAC_LEN);
+        memcpy(eth->src, peer_mac, NET_MAC_LEN);
+        eth->protocol16 = constswap16(NET_PROTOCOL_IP);
+        ip_hdr_t *iph = (ip_hdr_t *)(eth + 1);
+        iph->version = IP_VERSION_4;
+        iph->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+        iph->total_len16 = swap16(FRAME_LEN - sizeof(ether_hdr_t));
+        iph->ttl = IP_DEFALUT_TTL;
+        iph->protocol = NET_PROTOCOL_UDP;
+        uint8_t src[] = {192, 168, 56, 9}, dst[] = {a, b, i, 1 + i};
+        memcpy(iph->src_ip, src, NET_IP_LEN);
+        memcpy(iph->dst_ip, dst, NET_IP_LEN);
+        iph->hdr_checksum16 = checksum16((uint16_t *)iph, sizeof(ip_hdr_t));
+    }
+}
+
+/**
+ * @brief 反复把一批帧交给ethernet_in_burst，每批前恢复被转发改写的帧
+ *        恢复帧模拟驱动收到新的帧，它的开销计入结果
+ */
+static void bench(const char *name)
+{
+    uint64_t before = ip_stats.forwarded;
+    double begin = now_sec();
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        for (int i = 0; i < NET_BURST_SIZE; i++)
+        {
+            memcpy(frames[i] + BUF_HEADROOM, templates[i], FRAME_LEN);
+            buf_init_ref(&bufs[i], frames[i] + BUF_HEADROOM, FRAME_LEN);
+        }
+        ethernet_in_burst(vec, NET_BURST_SIZE);
+        driver_flush();
+    }
+    double sec = now_sec() - begin;
+    uint64_t forwarded = ip_stats.forwarded - before;
+    printf("%-28s %8.2f Mpps  %6.1f ns/pkt\n", name, forwarded / sec / 1e6, sec * 1e9 / forwarded);
+}
+
+int main(int argc, char const *argv[])
+{
+    net_init();
+    ip_forwarding = 1;
+    for (int i = 0; i < NET_BURST_SIZE; i++)
+        vec[i] = &bufs[i];
+
+    // 网关已解析，转发时直接使用下一跳中缓存的mac
+    route_add((uint8_t[]){10, 0, 0, 0}, 8, gw_ip, 0);
+    resolve(gw_ip, gw_mac);
+    make_templates(10, 1);
+    bench("via gateway (cached mac)");
+
+    // 直连的目的地址逐包查arp表
+    for (int i = 0; i < NET_BURST_SIZE; i++)
+    {
+        uint8_t ip[] = {172, 16, i, 1 + i}, mac[] = {0x02, 0, 0, 0, 0, 0x10 + i};
+        resolve(ip, mac);
+    }
+    make_templates(172, 16);
+    bench("on-link (arp table lookup)");
+    printf("%llu frames transmitted\n", (unsigned long long)tx_count);
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "map.h"
+#include "clock.h"
+
+#define LEGACY_MAP_LEN (16 * BUF_MAX_LEN) //旧版map内嵌数组的长度
+
+/**
+ * @brief 旧版map的布局：键值对顺序存放在定长数组中，查找时线性扫描每个槽位
+ *
+ */
+typedef struct legacy_map
+{
+    size_t key_len;
+    size_t value_len;
+    size_t size;
+    size_t max_size;
+    time_t timeout;
+    uint8_t data[LEGACY_MAP_LEN];
+} legacy_map_t;
+
+static void legacy_map_init(legacy_map_t *map, size_t key_len, size_t value_len, time_t timeout)
+{
+    memset(map, 0, sizeof(legacy_map_t));
+    map->key_len = key_len;
+    map->value_len = value_len;
+    map->max_size = LEGACY_MAP_LEN / (key_len + value_len + sizeof(time_t));
+    map->timeout = timeout;
+}
+
+static uint8_t *legacy_map_entry_get(legacy_map_t *map, size_t pos)
+{
+    return map->data + pos * (map->key_len + map->value_len + sizeof(time_t));
+}
+
+static int legacy_map_entry_valid(legacy_map_t *map, const void *entry)
+{
+    time_t entry_time = *(time_t *)((uint8_t *)entry + map->key_len + map->value_len);
+    return entry_time && (!map->timeout || entry_time + map->timeout >= time(NULL));
+}
+
+static void *legacy_map_get(legacy_map_t *map, const void *key)
+{
+    for (size_t i = 0; i < map->max_size; i++)
+    {
+        uint8_t *entry = legacy_map_entry_get(map, i);
+        if (legacy_map_entry_valid(map, entry) && !memcmp(key, entry, map->key_len))
+            return entry + map->key_len;
+    }
+    return NULL;
+}
+
+static int legacy_map_set(legacy_map_t *map, const void *key, const void *value)
+{
+    for (size_t i = 0; i < map->max_size; i++)
+    {
+        uint8_t *entry = legacy_map_entry_get(map, i);
+        if (!legacy_map_entry_valid(map, entry))
+        {
+            memcpy(entry, key, map->key_len);
+            memcpy(entry + map->key_len, value, map->value_len);
+            *(time_t *)(entry + map->key_len + map->value_len) = time(NULL);
+            map->size++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static legacy_map_t legacy;
+static map_t map;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static volatile uintptr_t sink;
+
+/**
+ * @brief 以ARP表的形状(4字节ip -> 6字节mac，带超时)测量两种布局的查找耗时
+ *
+ * @param entries 表中条目数
+ */
+static void bench(uint32_t entries)
+{
+    uint8_t mac[6] = {0};
+    legacy_map_init(&legacy, sizeof(uint32_t), sizeof(mac), 300);
+    map_init(&map, sizeof(uint32_t), sizeof(mac), 0, 300, NULL, NULL);
+    for (uint32_t i = 0; i < entries; i++)
+    {
+        memcpy(mac, &i, sizeof(i));
+        map_set(&map, &i, mac);
+        if (entries <= 1000) // 旧布局插入同样是线性扫描，大表只直接填充
+            legacy_map_set(&legacy, &i, mac);
+        else
+        {
+            uint8_t *entry = legacy_map_entry_get(&legacy, i);
+            memcpy(entry, &i, sizeof(i));
+            memcpy(entry + sizeof(i), mac, sizeof(mac));
+            *(time_t *)(entry + sizeof(i) + sizeof(mac)) = time(NULL);
+        }
+    }
+
+    // 每次查找的键在表内均匀分布，旧布局平均扫描一半的有效条目，未命中时扫描全部槽位
+    uint32_t lookups = 1000000;
+    double begin = now_sec();
+    for (uint32_t i = 0; i < lookups; i++)
+    {
+        uint32_t key = (i * 2654435761u) % entries;
+        sink += (uintptr_t)map_get(&map, &key);
+    }
+    double hash_ns = (now_sec() - begin) * 1e9 / lookups;
+
+    uint32_t legacy_lookups = entries > 1000 ? 200 : 20000;
+    begin = now_sec();
+    for (uint32_t i = 0; i < legacy_lookups; i++)
+    {
+        uint32_t key = (i * 2654435761u) % entries;
+        sink += (uintptr_t)legacy_map_get(&legacy, &key);
+    }
+    double legacy_ns = (now_sec() - begin) * 1e9 / legacy_lookups;
+
+    uint32_t miss = entries;
+    begin = now_sec();
+    for (uint32_t i = 0; i < lookups; i++)
+        sink += (uintptr_t)map_get(&map, &miss);
+    double hash_miss_ns = (now_sec() - begin) * 1e9 / lookups;
+
+    begin = now_sec();
+    for (uint32_t i = 0; i < 200; i++)
+        sink += (uintptr_t)legacy_map_get(&legacy, &miss);
+    double legacy_miss_ns = (now_sec() - begin) * 1e9 / 200;
+
+    printf("%6u entries | hit: hash %8.1f ns  linear %12.1f ns | miss: hash %8.1f ns  linear %12.1f ns\n",
+           entries, hash_ns, legacy_ns, hash_miss_ns, legacy_miss_ns);
+}
+
+int main(int argc, char const *argv[])
+{
+    clock_init();
+    bench(10);
+    bench(1000);
+    bench(50000);
+    return 0;
+}
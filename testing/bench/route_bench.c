@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "route.h"
+#include "clock.h"
+
+#define ROUTES 500000  //合成路由表的路由条数
+#define GATEWAYS 64    //合成路由表中不同网关的个数
+#define ADDRS (1 << 20) //查找用的地址数，循环使用
+
+uint32_t arp_generation = 1;
+
+static volatile uintptr_t sink;
+static uint8_t addrs[ADDRS][NET_IP_LEN];
+static map_t by_len; //对照：每个前缀长度一张哈希表，从长到短逐个查找
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void to_ip(uint32_t addr, uint8_t *ip)
+{
+    ip[0] = addr >> 24, ip[1] = addr >> 16, ip[2] = addr >> 8, ip[3] = addr;
+}
+
+static uint32_t rand32()
+{
+    return (uint32_t)rand() << 16 ^ rand();
+}
+
+/**
+ * @brief 前缀长度的分布大致仿照互联网全表：过半是/24，其余多为/16到/23，长于/24的很少
+ */
+static uint8_t rand_len()
+{
+    int r = rand() % 100;
+    if (r < 55)
+        return 24;
+    if (r < 95)
+        return 16 + rand() % 8;
+    if (r < 99)
+        return 8 + rand() % 8;
+    return 25 + rand() % 8;
+}
+
+static void *by_len_lookup(const uint8_t *ip)
+{
+    route_key_t key = {0};
+    uint32_t addr = (uint32_t)ip[0] << 24 | ip[1] << 16 | ip[2] << 8 | ip[3];
+    for (int len = 32; len >= 0; len--)
+    {
+        uint32_t prefix = len ? addr & UINT32_MAX << (32 - len) : 0;
+        to_ip(prefix, key.prefix);
+        key.len = len;
+        void *value = map_get(&by_len, &key);
+        if (value)
+            return value;
+    }
+    return NULL;
+}
+
+int main(int argc, char const *argv[])
+{
+    clock_init();
+    route_init();
+    map_init(&by_len, sizeof(route_key_t), sizeof(uint16_t), 0, 0, NULL, NULL);
+    srand(1);
+
+    double begin = now_sec();
+    uint32_t *prefixes = malloc(ROUTES * sizeof(uint32_t));
+    uint8_t *lens = malloc(ROUTES);
+    // 随机前缀可能重复，重复时只是替换下一跳，添加到不同的前缀数够为止
+    for (size_t n = 0; n < ROUTES; n = route_size())
+    {
+        uint8_t len = rand_len(), prefix[NET_IP_LEN], gateway[NET_IP_LEN] = {10, 0, 0, 1 + n % GATEWAYS};
+        uint32_t addr = rand32() & UINT32_MAX << (32 - len);
+        prefixes[n] = addr;
+        lens[n] = len;
+        to_ip(addr, prefix);
+        if (route_add(prefix, len, gateway, 0) == -1)
+        {
+            printf("route_add failed after %zu routes\n", n);
+            return -1;
+        }
+    }
+    double add_sec = now_sec() - begin;
+    printf("%zu routes added in %.2f s\n", route_size(), add_sec);
+
+    // 一半地址落在已有前缀内，一半完全随机
+    for (int i = 0; i < ADDRS; i++)
+        to_ip(i % 2 ? prefixes[rand() % ROUTES] | (rand() & 0xff) : rand32(), addrs[i]);
+    for (int i = 0; i < ROUTES; i++)
+    {
+        route_key_t key = {0};
+        uint8_t ip[NET_IP_LEN];
+        to_ip(prefixes[i], ip);
+        uint16_t value = 1 + i % GATEWAYS;
+        memcpy(key.prefix, ip, NET_IP_LEN);
+        key.len = lens[i];
+        map_set(&by_len, &key, &value);
+    }
+
+    uint32_t lookups = 32 * ADDRS;
+    begin = now_sec();
+    for (uint32_t i = 0; i < lookups; i++)
+        sink += (uintptr_t)route_lookup(addrs[i & (ADDRS - 1)]);
+    double dir_ns = (now_sec() - begin) * 1e9 / lookups;
+
+    uint32_t slow_lookups = ADDRS;
+    begin = now_sec();
+    for (uint32_t i = 0; i < slow_lookups; i++)
+        sink += (uintptr_t)by_len_lookup(addrs[i]);
+    double hash_ns = (now_sec() - begin) * 1e9 / slow_lookups;
+
+    printf("lookup: dir-24-8 %6.1f ns (%.1f M/s) | hash per length %8.1f ns (%.1f M/s)\n",
+           dir_ns, 1e3 / dir_ns, hash_ns, 1e3 / hash_ns);
+    free(prefixes);
+    free(lens);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include "buf.h"
+#include "utils.h"
+#include "test.h"
+
+int main(int argc, char* argv[])
+{
+        buf_t buf = {0}, clone, copy, big = {0};
+        printf("\e[0;34mTest begin.\n");
+
+        // 以太网帧放在池中的一个数据块里，数据按cache line对齐
+        CHECK(buf_init(&buf, 1514) == 0);
+        CHECK(buf.size <= BUF_BLOCK_LEN && ((uintptr_t)buf.payload % BUF_ALIGN) == 0);
+        CHECK(buf.data == buf.payload + BUF_HEADROOM && buf.len == 1514);
+        memset(buf.data, 0xab, buf.len);
+        CHECK(buf_add_header(&buf, BUF_HEADROOM) == 0);
+        CHECK(buf_add_header(&buf, 1) == -1);
+        CHECK(buf_remove_header(&buf, BUF_HEADROOM) == 0);
+        CHECK(buf_add_padding(&buf, buf.size - BUF_HEADROOM - buf.len) == 0);
+        CHECK(buf_add_padding(&buf, 1) == -1);
+        CHECK(buf_remove_padding(&buf, buf.size - BUF_HEADROOM - 1514) == 0);
+
+        // 浅拷贝共享数据块，原buffer重新初始化时换成新的数据块
+        buf_clone(&clone, &buf, 0);
+        CHECK(clone.mem == buf.mem && buf.mem->ref == 2);
+        uint8_t *shared = buf.payload;
+        CHECK(buf_init(&buf, 64) == 0);
+        CHECK(buf.payload != shared && clone.payload == shared && clone.mem->ref == 1);
+        CHECK(clone.len == 1514 && clone.data[0] == 0xab && clone.data[1513] == 0xab);
+
+        // 深拷贝只复制有效数据，保留头部空间
+        buf_copy(&copy, &clone, 0);
+        CHECK(copy.mem != clone.mem && copy.data - copy.payload == clone.data - clone.payload);
+        CHECK(copy.len == clone.len && !memcmp(copy.data, clone.data, clone.len));
+
+        // 独占的数据块释放后回到池中被复用
+        buf_free(&clone);
+        CHECK(clone.mem == NULL && clone.len == 0);
+        CHECK(buf_init(&clone, 100) == 0 && clone.payload == shared);
+
+        // 超过池数据块容量的buffer单独分配
+        CHECK(buf_alloc(&big, UINT16_MAX) == 0);
+        CHECK(big.size >= BUF_HEADROOM + UINT16_MAX && big.len == 0);
+        CHECK(buf_add_padding(&big, UINT16_MAX) == 0);
+        CHECK(buf_init(&big, BUF_MAX_LEN) == -1);
+
+        // 分散/聚集链：头部段加奇数长度的外部负载段
+        uint8_t data[1001], flat[1100];
+        for (int i = 0; i < sizeof(data); i++)
+                data[i] = i * 7;
+        buf_t seg[3], slice[4];
+        CHECK(buf_init(&buf, 3) == 0);
+        memset(buf.data, 0x5a, 3);
+        buf_init_ref(&seg[0], data, 1);
+        buf_init_ref(&seg[1], data + 1, 500);
+        buf_init_ref(&seg[2], data + 501, 500);
+        buf.next = &seg[0];
+        seg[0].next = &seg[1];
+        seg[1].next = &seg[2];
+        CHECK(buf_chain_len(&buf) == 1004);
+        CHECK(buf_gather(&buf, flat, 1003) == 0);
+        CHECK(buf_gather(&buf, flat, sizeof(flat)) == 1004);
+        CHECK(flat[2] == 0x5a && !memcmp(flat + 3, data, sizeof(data)));
+        CHECK(buf_checksum16(&buf) == checksum16((uint16_t *)flat, 1004));
+
+        // 切片只引用数据
+        CHECK(buf_slice(slice, 4, &buf, 2, 600) == 4);
+        CHECK(buf_chain_len(slice) == 600 && slice[1].data == data && slice[3].data == data + 501);
+        CHECK(buf_slice(slice, 2, &buf, 2, 600) == -1);
+        CHECK(buf_slice(slice, 4, &buf, 1000, 5) == -1);
+
+        // 链不能共享，浅拷贝退化为连续的深拷贝
+        buf_clone(&copy, &buf, 0);
+        CHECK(copy.next == NULL && copy.len == 1004 && !memcmp(copy.data, flat, 1004));
+        buf_free(&copy);
+        CHECK(buf_linearize(&buf) == 0);
+        CHECK(buf.next == NULL && buf.len == 1004 && buf.data == buf.payload + BUF_HEADROOM);
+        CHECK(!memcmp(buf.data, flat, 1004));
+
+        // 留待发送时补全的校验和：聚集时随拷贝算出，软件补全的结果相同，校验范围随头部的装卸移动
+        uint8_t frame[1100];
+        CHECK(buf_init(&buf, 9) == 0);
+        memset(buf.data, 0x5a, 9);
+        buf.next = &seg[0];
+        buf_csum_partial(&buf, 1, 6, 0x1234);
+        CHECK(buf.csum_flags == BUF_CSUM_PARTIAL && buf.csum_start == 1);
+        CHECK(buf_add_header(&buf, 20) == 0 && buf.csum_start == 21);
+        memset(buf.data, 0, 20);
+        CHECK(buf_gather_csum(&buf, frame, 1029) == 0);
+        CHECK(buf_gather_csum(&buf, frame, sizeof(frame)) == 1030);
+        CHECK(checksum16((uint16_t *)(frame + 21), 1030 - 21) == 0x1234);
+        CHECK(!memcmp(frame + 29, data, sizeof(data)) && buf.csum_flags == BUF_CSUM_PARTIAL);
+        CHECK(buf_csum_resolve(&buf) == 0 && buf.csum_flags == 0);
+        CHECK(buf_gather(&buf, flat, sizeof(flat)) == 1030 && !memcmp(flat, frame, 1030));
+        CHECK(buf_init(&buf, 0) == 0 && buf.csum_flags == 0);
+
+        buf_free(&buf);
+        buf_free(&clone);
+        buf_free(&copy);
+        buf_free(&big);
+        if (failed) {
+                printf("\e[1;31m====> Buf test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Buf test passed.\n\e[0m");
+        return 0;
+}
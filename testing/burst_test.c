@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "driver.h"
+#include "ethernet.h"
+
+extern FILE *pcap_in;
+extern FILE *pcap_out;
+extern FILE *pcap_demo;
+extern FILE *control_flow;
+extern FILE *udp_fout;
+extern FILE *arp_log_f;
+
+int check_pcap();
+FILE* open_file(char * path, char * name, char * mode);
+
+uint8_t my_mac[] = NET_IF_MAC;
+uint8_t boardcast_mac[] = {0xff,0xff,0xff,0xff,0xff,0xff};
+
+static int is_local(buf_t *buf)
+{
+        return !memcmp(buf->data,my_mac,6) || !memcmp(buf->data,boardcast_mac,6);
+}
+
+/**
+ * @brief 在子进程中回放输入，发出的数据包写入out
+ *        逐包模式用driver_recv和ethernet_in，批量模式用driver_recv_burst和ethernet_in_burst
+ */
+static int replay(char *path, FILE *out, int burst)
+{
+        pid_t pid = fork();
+        if(pid == 0){
+                buf_t bufs[NET_BURST_SIZE] = {0};
+                buf_t *vec[NET_BURST_SIZE], *local[NET_BURST_SIZE];
+                pcap_in = open_file(path, "in.pcap","r");
+                pcap_out = out;
+                control_flow = udp_fout = arp_log_f = tmpfile();
+                if(pcap_in == 0 || control_flow == 0)
+                        _exit(1);
+                for(int i = 0; i < NET_BURST_SIZE; i++)
+                        vec[i] = &bufs[i];
+                net_init();
+                int n;
+                if(burst){
+                        while((n = driver_recv_burst(&net_ifs[0], vec, NET_BURST_SIZE)) > 0){
+                                int m = 0;
+                                for(int i = 0; i < n; i++)
+                                        if(is_local(vec[i]))
+                                                local[m++] = vec[i];
+                                ethernet_in_burst(local, m);
+                        }
+                }else{
+                        while((n = driver_recv(&net_ifs[0], &bufs[0])) > 0)
+                                if(is_local(&bufs[0]))
+                                        ethernet_in(&bufs[0]);
+                }
+                driver_close();
+                _exit(n < 0);
+        }
+        int status;
+        if(pid < 0 || waitpid(pid, &status, 0) != pid)
+                return -1;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main(int argc, char* argv[]){
+        printf("\e[0;34mTest begin.\n");
+        FILE *single = tmpfile(), *burst = tmpfile();
+        if(single == 0 || burst == 0){
+                printf("\e[1;31mFailed to create temporary files\n\e[0m");
+                return -1;
+        }
+        if(replay(argv[1], single, 0) || replay(argv[1], burst, 1)){
+                printf("\e[1;31mError occur on replaying input\n\e[0m");
+                return -1;
+        }
+        // 子进程与父进程共享文件偏移，此时位于文件尾，pcap文件头为24字节
+        if(ftell(single) <= 24){
+                printf("\e[1;31mNo packet sent in per-packet mode\n\e[0m");
+                return -1;
+        }
+        rewind(single);
+        rewind(burst);
+        pcap_demo = single;
+        pcap_out = burst;
+        printf("\e[0;34mComparing burst output with per-packet output\n");
+        return check_pcap() ? -1 : 0;
+}
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checksum.h"
+
+#define DATA_LEN (UINT16_MAX + 64)
+
+static const char *impls[] = {"generic", "sse2", "avx2"};
+static uint8_t data[DATA_LEN];
+
+/**
+ * @brief 参照实现，逐个16位字累加
+ */
+static uint16_t reference_sum16(const uint8_t *p, size_t len)
+{
+        uint32_t sum = 0;
+        uint16_t word;
+        for (; len > 1; p += 2, len -= 2) {
+                memcpy(&word, p, 2);
+                sum += word;
+                sum = (sum >> 16) + (sum & 0xffff);
+        }
+        if (len == 1) {
+                word = 0;
+                memcpy(&word, p, 1);
+                sum += word;
+        }
+        while (sum >> 16)
+                sum = (sum >> 16) + (sum & 0xffff);
+        return sum;
+}
+
+static uint8_t copy[DATA_LEN + 64];
+
+static int check(size_t offset, size_t len)
+{
+        uint16_t expect = reference_sum16(data + offset, len);
+        uint16_t got = checksum_sum16(data + offset, len);
+        if (got != expect) {
+                printf("\e[0;31m%s: offset %zu len %zu got %04x expected %04x\n",
+                       checksum_selected(), offset, len, got, expect);
+                return 1;
+        }
+        // 拷贝的同时求和，目标也不对齐，且不能写出界
+        size_t dst_offset = (offset * 5 + 3) % 32;
+        memset(copy, 0x5a, len + 64);
+        got = checksum_copy16(copy + dst_offset, data + offset, len);
+        if (got != expect || memcmp(copy + dst_offset, data + offset, len) ||
+            (dst_offset && copy[dst_offset - 1] != 0x5a) || copy[dst_offset + len] != 0x5a) {
+                printf("\e[0;31m%s: copy offset %zu len %zu got %04x expected %04x\n",
+                       checksum_selected(), offset, len, got, expect);
+                return 1;
+        }
+        return 0;
+}
+
+int main(int argc, char* argv[])
+{
+        int failed = 0;
+        printf("\e[0;34mTest begin.\n");
+        srand(1);
+        for (int i = 0; i < 3; i++) {
+                if (checksum_select(impls[i]) == -1) {
+                        printf("\e[0;33m%s is not supported, skipped\n", impls[i]);
+                        continue;
+                }
+                // 全0xff的数据让累加器尽快进位
+                memset(data, 0xff, sizeof(data));
+                failed |= check(0, UINT16_MAX) | check(1, UINT16_MAX);
+                for (size_t j = 0; j < sizeof(data); j++)
+                        data[j] = rand();
+                // 奇数长度与不对齐的起始地址
+                for (size_t offset = 0; offset < 32; offset++)
+                        for (size_t len = 0; len <= 300; len++)
+                                failed |= check(offset, len);
+                for (size_t len = 1400; len <= 1520; len++)
+                        failed |= check(len % 7, len);
+                failed |= check(0, UINT16_MAX + 1) | check(3, UINT16_MAX) | check(63, UINT16_MAX - 62);
+        }
+        checksum_select(NULL);
+        printf("\e[0;34mUsing %s.\n", checksum_selected());
+
+        // 改写首部字段后增量更新的校验和与重新计算的相同
+        for (int i = 0; i < 10000; i++) {
+                uint8_t pkt[64];
+                uint16_t check, old16, new16 = rand();
+                uint32_t old32, new32 = (uint32_t)rand() << 16 ^ rand();
+                size_t len = 26 + rand() % 38, pos = rand() % 10 * 2;
+                for (size_t j = 0; j < len; j++)
+                        pkt[j] = i % 3 ? rand() : 0xff;
+                memset(pkt + 20, 0, 2); // 校验和字段
+                check = ~checksum_sum16(pkt, len);
+                memcpy(pkt + 20, &check, 2);
+                memcpy(&old16, pkt + pos, 2);
+                memcpy(pkt + pos, &new16, 2);
+                check = checksum_adjust16(check, old16, new16);
+                memcpy(&old32, pkt + 22, 4);
+                memcpy(pkt + 22, &new32, 4);
+                check = checksum_adjust32(check, old32, new32);
+                memcpy(pkt + 20, &check, 2);
+                if (checksum_sum16(pkt, len) != 0xffff) {
+                        printf("\e[0;31mAdjusted checksum mismatch in round %d\n", i);
+                        failed = 1;
+                }
+                // 任意位置切开分别求和再合并
+                size_t cut = rand() % (len + 1);
+                uint16_t sum = checksum_combine(checksum_sum16(pkt, cut), checksum_sum16(pkt + cut, len - cut), cut);
+                if (sum != reference_sum16(pkt, len)) {
+                        printf("\e[0;31mCombined sum mismatch at %zu/%zu\n", cut, len);
+                        failed = 1;
+                }
+        }
+        if (failed) {
+                printf("\e[1;31m====> Checksum test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Checksum test passed.\n\e[0m");
+        return 0;
+}
@@ -1,4 +1,5 @@
 #include "net.h"
+#include "arp.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -13,6 +14,7 @@ void fprint_buf(FILE* f, buf_t* buf);
 
 map_t arp_table;
 map_t arp_buf;
+uint32_t arp_generation = 1;
 
 // void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 // {
@@ -36,9 +38,14 @@ void arp_out(buf_t *buf, uint8_t *ip)
         fprint_buf(arp_fout,buf);
 }
 
+void arp_out_cached(buf_t *buf, uint8_t *ip, arp_cache_t *cache)
+{
+        arp_out(buf, ip);
+}
+
 void arp_init()
 {
-    map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL);
-    map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy);
+    map_init(&arp_table, NET_IP_LEN, sizeof(arp_entry_t), 0, ARP_TIMEOUT_SEC, NULL, NULL);
+    map_init(&arp_buf, NET_IP_LEN, sizeof(arp_pending_t), 0, ARP_MIN_INTERVAL, NULL, NULL);
     net_add_protocol(NET_PROTOCOL_ARP, arp_in);
 }
\ No newline at end of file
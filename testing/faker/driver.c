@@ -3,6 +3,8 @@
 #include <utils.h>
 #include "config.h"
 #include "buf.h"
+#include "clock.h"
+#include "net.h"
 
 static pcap_t *pcap;
 static pcap_dumper_t *pdump;
@@ -33,8 +35,11 @@ BOOL LoadNpcapDlls()
 }
 #endif
 
-int driver_open()
+// 回放文件只对应默认网卡，其他网卡收不到包，发出的包与默认网卡写入同一个文件
+int driver_open(net_if_t *netif)
 {
+        if (netif->index != 0)
+                return 0;
 #ifdef _WIN32
         /* Load Npcap and its functions. */
         if (!LoadNpcapDlls())
@@ -55,12 +60,15 @@ int driver_open()
                 return -1;
         }
 
+        clock_set_virtual(0); //离线回放使用虚拟时钟，由抓包时间戳驱动
         fprintf(control_flow,"driver opened\n");
         return 0;
 }
 
-int driver_recv(buf_t *buf)
+int driver_recv(net_if_t *netif, buf_t *buf)
 {
+        if (netif->index != 0)
+                return 0;
         struct pcap_pkthdr *pkt_hdr;
         const uint8_t *pkt_data;
         int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
@@ -68,25 +76,68 @@ int driver_recv(buf_t *buf)
                 // printf("meet end of file\n");
                 return 0;
         }else if (ret == 1){
-                buf_init(buf,pkt_hdr->len);
-                memcpy(buf->data, pkt_data, pkt_hdr->len);
-                return pkt_hdr->len;
+                clock_set_virtual((uint64_t)pkt_hdr->ts.tv_sec * 1000 + pkt_hdr->ts.tv_usec / 1000);
+                buf_free(buf);
+                buf_init_ref(buf, (uint8_t *)pkt_data, pkt_hdr->caplen);
+                buf->if_index = netif->index;
+                return pkt_hdr->caplen;
         }else{
                 fprintf(stderr, "Error in driver_recv: %s\n", pcap_geterr(pcap));
                 return -1;
         }
 }
 
+int driver_recv_burst(net_if_t *netif, buf_t **bufs, int max)
+{
+        if (netif->index != 0)
+                return 0;
+        struct pcap_pkthdr *pkt_hdr;
+        const uint8_t *pkt_data;
+        int n = 0;
+        while (n < max){
+                int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
+                if (ret == PCAP_ERROR_BREAK)
+                        break;
+                if (ret != 1){
+                        fprintf(stderr, "Error in driver_recv_burst: %s\n", pcap_geterr(pcap));
+                        return n ? n : -1;
+                }
+                clock_set_virtual((uint64_t)pkt_hdr->ts.tv_sec * 1000 + pkt_hdr->ts.tv_usec / 1000);
+                if (buf_init(bufs[n], pkt_hdr->caplen) == -1)
+                        continue;
+                memcpy(bufs[n]->data, pkt_data, pkt_hdr->caplen);
+                n++;
+        }
+        return n;
+}
+
 int driver_send(buf_t *buf)
 {
+        static uint8_t frame[BUF_BLOCK_LEN];
         struct pcap_pkthdr header;
+        size_t len = buf_gather_csum(buf, frame, sizeof(frame));
         memset(&header.ts,0,sizeof(header.ts));
-        header.caplen = buf->len;
-        header.len = buf->len;
-        pcap_dump((u_char *)pdump,&header,buf->data);
+        header.caplen = len;
+        header.len = len;
+        pcap_dump((u_char *)pdump,&header,frame);
         return 0;
 }
 
+int driver_tx_room(net_if_t *netif)
+{
+        return DRIVER_TX_QUEUE_LEN;
+}
+
+int driver_flush()
+{
+        return 0; // 发出的包立即写入文件，无需排队
+}
+
+int driver_fd(net_if_t *netif)
+{
+        return -1;
+}
+
 void driver_close()
 {
         fprintf(control_flow,"\ndriver closed\n");
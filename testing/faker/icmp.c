@@ -30,6 +30,21 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
         fprint_buf(icmp_fout, recv_buf);
 }
 
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip)
+{
+        fprintf(icmp_fout,"icmp_time_exceeded:\n");
+        fprintf(icmp_fout,"\tip: %s\n",print_ip(src_ip));
+        fprint_buf(icmp_fout, recv_buf);
+}
+
+void icmp_frag_needed(buf_t *recv_buf, uint8_t *src_ip, uint16_t mtu)
+{
+        fprintf(icmp_fout,"icmp_frag_needed:\n");
+        fprintf(icmp_fout,"\tip: %s\n",print_ip(src_ip));
+        fprintf(icmp_fout,"\tmtu: %d\n",mtu);
+        fprint_buf(icmp_fout, recv_buf);
+}
+
 void icmp_init(){
     net_add_protocol(NET_PROTOCOL_ICMP, icmp_in);
 }
\ No newline at end of file
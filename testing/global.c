@@ -4,7 +4,10 @@
 #include <string.h>
 #include <pcap.h>
 #include "map.h"
+#include "ethernet.h"
 #include "arp.h"
+#include "ip.h"
+#include "checksum.h"
 #include "utils.h"
 
 FILE *control_flow;
@@ -58,6 +61,66 @@ FILE* open_file(char * path, char * name, char * mode) {
         return fopen(filename, mode);
 }
 
+/**
+ * @brief 生成一个sender发出的arp报文，应答的目标mac为默认网卡的mac，请求的为0
+ *        报文放在一个共享的buffer中，下次调用时被覆盖
+ */
+buf_t* arp_pkt_build(uint16_t opcode, uint8_t *sender_ip, uint8_t *sender_mac, uint8_t *target_ip)
+{
+        static buf_t buf;
+        buf_init(&buf, sizeof(arp_pkt_t));
+        arp_pkt_t *pkt = (arp_pkt_t *)buf.data;
+        memset(pkt, 0, sizeof(arp_pkt_t));
+        pkt->hw_type16 = constswap16(ARP_HW_ETHER);
+        pkt->pro_type16 = constswap16(NET_PROTOCOL_IP);
+        pkt->hw_len = NET_MAC_LEN;
+        pkt->pro_len = NET_IP_LEN;
+        pkt->opcode16 = swap16(opcode);
+        memcpy(pkt->sender_mac, sender_mac, NET_MAC_LEN);
+        memcpy(pkt->sender_ip, sender_ip, NET_IP_LEN);
+        if(opcode == ARP_REPLY)
+                memcpy(pkt->target_mac, net_if_mac, NET_MAC_LEN);
+        memcpy(pkt->target_ip, target_ip, NET_IP_LEN);
+        return &buf;
+}
+
+/**
+ * @brief 填写一个负载长度为payload_len的ipv4首部并计算首部校验和
+ */
+void ipv4_hdr_build(ip_hdr_t *iph, uint8_t *src, uint8_t *dst, uint8_t protocol, uint16_t id, uint8_t ttl, uint16_t flags, size_t payload_len)
+{
+        memset(iph, 0, sizeof(ip_hdr_t));
+        iph->version = IP_VERSION_4;
+        iph->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+        iph->total_len16 = swap16(sizeof(ip_hdr_t) + payload_len);
+        iph->id16 = swap16(id);
+        iph->flags_fragment16 = swap16(flags);
+        iph->ttl = ttl;
+        iph->protocol = protocol;
+        memcpy(iph->src_ip, src, NET_IP_LEN);
+        memcpy(iph->dst_ip, dst, NET_IP_LEN);
+        iph->hdr_checksum16 = checksum16((uint16_t *)iph, sizeof(ip_hdr_t));
+}
+
+/**
+ * @brief 生成一个从网卡if_index收到的、发往该网卡mac的udp协议号的ip帧，负载填0x5a
+ *        源mac为02:00加上源ip地址，flags为ip头中的标志与分片偏移
+ */
+void ipv4_frame_build(buf_t *buf, uint8_t if_index, uint8_t *src, uint8_t *dst, uint8_t ttl, uint16_t flags, size_t payload_len)
+{
+        buf_init(buf, sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + payload_len);
+        buf->if_index = if_index;
+        ether_hdr_t *eth = (ether_hdr_t *)buf->data;
+        memcpy(eth->dst, net_ifs[if_index].mac, NET_MAC_LEN);
+        eth->src[0] = 0x02;
+        eth->src[1] = 0;
+        memcpy(eth->src + 2, src, NET_IP_LEN);
+        eth->protocol16 = constswap16(NET_PROTOCOL_IP);
+        ip_hdr_t *iph = (ip_hdr_t *)(eth + 1);
+        ipv4_hdr_build(iph, src, dst, NET_PROTOCOL_UDP, 0, ttl, flags, payload_len);
+        memset(iph + 1, 0x5a, payload_len);
+}
+
 ssize_t getline(char **lineptr, size_t *n, FILE *fp) {
         int i;
         if (*lineptr == NULL || *n < 256) {
@@ -127,50 +190,39 @@ void fprint_buf(FILE* f, buf_t* buf)
         if(buf == 0){
                 fprintf(f,"(null)\n");
         }else{
-                for(int i = 0; i < buf->len; i++){
-                        fprintf(f," %02x",buf->data[i]);
+                for(buf_t *seg = buf; seg; seg = seg->next){
+                        for(int i = 0; i < seg->len; i++){
+                                fprintf(f," %02x",seg->data[i]);
+                        }
                 }
                 fprintf(f,"\n");
         }
 }
 
-static inline void *map_entry_get(map_t *map, size_t pos)
+static void log_arp_table_entry(void *ip, void *mac, time_t *timestamp)
 {
-        if (pos >= map->max_size)
-                return NULL;
-        return map->data + pos * (map->key_len + map->value_len + sizeof(time_t));
+        fprintf(arp_log_f, "%s -> %s\n", print_ip(ip), print_mac(mac));
 }
 
-static inline int map_entry_valid(map_t *map, const void *entry)
+static void log_arp_buf_entry(void *ip, void *value, time_t *timestamp)
 {
-        time_t entry_time = *(time_t *)((uint8_t *)entry + map->key_len + map->value_len);
-        return entry_time && (!map->timeout || entry_time + map->timeout >= time(NULL));
+        arp_pending_t *pending = value;
+        for(int n = 0; n < pending->count; n++){
+                buf_t *buf = &pending->bufs[n];
+                fprintf(arp_log_f, "%s -> ", print_ip(ip));
+                for(int i = 0; i < buf->len; i++){
+                        fprintf(arp_log_f," %02x",buf->data[i]);
+                }
+                fputc('\n', arp_log_f);
+        }
 }
 
 void log_tab_buf(){
         fprintf(arp_log_f, "<====== arp table =======>\n");
-        for (size_t i = 0; i < arp_table.max_size; i++)
-        {
-                uint8_t *entry = (uint8_t*) map_entry_get(&arp_table, i);
-                if (map_entry_valid(&arp_table, entry))
-                        fprintf(arp_log_f, "%s -> %s\n",
-                                print_ip(entry),
-                                print_mac(entry + arp_table.key_len));
-        }
+        map_foreach(&arp_table, log_arp_table_entry);
 
         fprintf(arp_log_f, "<====== arp buf =======>\n");
-        for (size_t i = 0; i < arp_buf.max_size; i++)
-        {
-                uint8_t *entry = (uint8_t*) map_entry_get(&arp_buf, i);
-                if (map_entry_valid(&arp_buf, entry)) {
-                        fprintf(arp_log_f, "%s -> ", print_ip(entry));
-                        buf_t * buf = (buf_t*) (entry + arp_buf.key_len);
-                        for(int i = 0; i < buf->len; i++){
-                                fprintf(arp_log_f," %02x",buf->data[i]);
-                        }
-                        fputc('\n', arp_log_f);
-                }
-        }
+        map_foreach(&arp_buf, log_arp_buf_entry);
 }
 
 
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "route.h"
+#include "driver.h"
+#include "clock.h"
+#include "utils.h"
+#include "test.h"
+
+#define PAYLOAD_LEN 26 //测试帧的ip负载长度
+
+static uint8_t peer_ip[] = {192, 168, 163, 9};
+static uint8_t peer_mac[] = {0x02, 0, 0, 0, 0, 0x09};
+static uint8_t gw_mac[] = {0x02, 0, 0, 0, 0, 0x01};
+static uint8_t gw_ip[] = {192, 168, 163, 1};
+static uint8_t remote_ip[] = {10, 1, 2, 3};
+
+int main(int argc, char* argv[]){
+        printf("\e[0;34mTest begin.\n");
+        pcap_in = open_file(argv[1], "in.pcap","r");
+        pcap_out = tmpfile();
+        control_flow = ip_fout = icmp_fout = udp_fout = arp_log_f = tmpfile();
+        if(pcap_in == 0 || pcap_out == 0 || control_flow == 0){
+                printf("\e[1;31mFailed to open files\n\e[0m");
+                return -1;
+        }
+        net_init();
+        CHECK(ip_forwarding == IP_FORWARD);
+        CHECK(route_add((uint8_t[]){10, 0, 0, 0}, 8, gw_ip, 0) == 0);
+
+        // 未开启转发时丢弃目的地址不是本机的包
+        buf_t buf = {0};
+        ip_forwarding = 0;
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 64, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(ip_stats.forwarded == 0);
+
+        // 网关未解析时进入arp等待队列
+        ip_forwarding = 1;
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 64, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(ip_stats.forwarded == 1 && arp_stats.queued == 1);
+        arp_in(arp_pkt_build(ARP_REPLY, gw_ip, gw_mac, net_if_ip), gw_mac);
+        CHECK(arp_stats.flushed == 1);
+
+        // 经网关转发：在原帧上改写TTL、首部校验和与以太网头
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 64, 0, PAYLOAD_LEN);
+        uint8_t *frame = buf.data;
+        ethernet_in(&buf);
+        ether_hdr_t *eth = (ether_hdr_t *)buf.data;
+        ip_hdr_t *iph = (ip_hdr_t *)(eth + 1);
+        CHECK(ip_stats.forwarded == 2 && buf.data == frame);
+        CHECK(!memcmp(eth->dst, gw_mac, NET_MAC_LEN) && !memcmp(eth->src, net_if_mac, NET_MAC_LEN));
+        CHECK(iph->ttl == 63 && checksum16((uint16_t *)iph, sizeof(ip_hdr_t)) == 0);
+        CHECK(!memcmp(iph->dst_ip, remote_ip, NET_IP_LEN) && buf.len == sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + PAYLOAD_LEN);
+
+        // 直连的目的地址按目的地址本身解析
+        uint8_t neighbour_ip[] = {192, 168, 163, 77};
+        ipv4_frame_build(&buf, 0, peer_ip, neighbour_ip, 64, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(ip_stats.forwarded == 3 && arp_stats.queued == 2);
+
+        // 以链路层广播收到的包与发往直连子网广播地址的包不转发
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 64, 0, PAYLOAD_LEN);
+        memset(((ether_hdr_t *)buf.data)->dst, 0xff, NET_MAC_LEN);
+        ethernet_in(&buf);
+        uint8_t subnet_bcast[] = {192, 168, 163, 255};
+        ipv4_frame_build(&buf, 0, peer_ip, subnet_bcast, 64, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(ip_stats.forwarded == 3 && arp_stats.queued == 2);
+
+        // TTL耗尽与没有路由时丢弃，TTL耗尽的回复icmp超时
+        arp_in(arp_pkt_build(ARP_REPLY, peer_ip, peer_mac, net_if_ip), peer_mac);
+        uint64_t sent = net_ifs[0].stats.tx_packets;
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 1, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(ip_stats.forwarded == 3 && ip_stats.ttl_exceeded == 1);
+        CHECK(net_ifs[0].stats.tx_packets == sent + 1);
+        ip_hdr_t *reply = (ip_hdr_t *)(txbuf.data + sizeof(ether_hdr_t));
+        icmp_hdr_t *ich = (icmp_hdr_t *)(reply + 1);
+        CHECK(ich->type == ICMP_TYPE_TIME_EXCEEDED && !memcmp(reply->dst_ip, peer_ip, NET_IP_LEN));
+        CHECK(swap16(reply->total_len16) == sizeof(ip_hdr_t) + sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
+
+        // 原数据报不足ip头加8字节时只引用实际的长度
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 1, 0, 0);
+        ethernet_in(&buf);
+        CHECK(net_ifs[0].stats.tx_packets == sent + 2);
+        reply = (ip_hdr_t *)(txbuf.data + sizeof(ether_hdr_t));
+        CHECK(swap16(reply->total_len16) == sizeof(ip_hdr_t) + sizeof(icmp_hdr_t) + sizeof(ip_hdr_t));
+
+        // icmp差错报文与非首个分片不回复差错报文
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 1, 0, PAYLOAD_LEN);
+        iph = (ip_hdr_t *)(buf.data + sizeof(ether_hdr_t));
+        ipv4_hdr_build(iph, peer_ip, remote_ip, NET_PROTOCOL_ICMP, 0, 1, 0, PAYLOAD_LEN);
+        ((icmp_hdr_t *)(iph + 1))->type = ICMP_TYPE_TIME_EXCEEDED;
+        ethernet_in(&buf);
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 1, 1480 / IP_HDR_OFFSET_PER_BYTE, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(ip_stats.ttl_exceeded == 4 && net_ifs[0].stats.tx_packets == sent + 2);
+
+        // 差错报文按令牌桶限速，时钟推进后恢复
+        for(int i = 0; i < ICMP_ERROR_BURST + 10; i++){
+                ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 1, 0, PAYLOAD_LEN);
+                ethernet_in(&buf);
+        }
+        CHECK(net_ifs[0].stats.tx_packets < sent + 2 + ICMP_ERROR_BURST + 10);
+        sent = net_ifs[0].stats.tx_packets;
+        clock_advance(1000);
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, 1, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(net_ifs[0].stats.tx_packets == sent + 1);
+        CHECK(route_delete((uint8_t[]){0, 0, 0, 0}, 0) == 0);
+        ipv4_frame_build(&buf, 0, peer_ip, neighbour_ip, 64, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(ip_stats.forwarded == 3 && ip_stats.no_route == 1);
+
+        // 批量路径中转发的包与交给本机的包各自处理
+        buf_t frames[3] = {0};
+        buf_t *vec[3] = {&frames[0], &frames[1], &frames[2]};
+        ipv4_frame_build(&frames[0], 0, peer_ip, remote_ip, 64, 0, PAYLOAD_LEN);
+        ipv4_frame_build(&frames[1], 0, peer_ip, net_if_ip, 64, 0, PAYLOAD_LEN);
+        ipv4_frame_build(&frames[2], 0, peer_ip, remote_ip, 8, 0, PAYLOAD_LEN);
+        ethernet_in_burst(vec, 3);
+        CHECK(ip_stats.forwarded == 5);
+        CHECK(((ip_hdr_t *)(frames[2].data + sizeof(ether_hdr_t)))->ttl == 7);
+
+        for(int i = 0; i < 3; i++)
+                buf_free(&frames[i]);
+        buf_free(&buf);
+        driver_close();
+        if (failed) {
+                printf("\e[1;31m====> Ip forward test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Ip forward test passed.\n\e[0m");
+        return 0;
+}
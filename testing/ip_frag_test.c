@@ -21,15 +21,15 @@ int main(int argc, char* argv[])
                 return -1;
         }
         arp_fout = control_flow;
-        uint8_t * p = buf.payload + 1000;
-        buf.data = p;
-        buf.len = 0;
+        buf_alloc(&buf, UINT16_MAX);
+        uint8_t * p = buf.data;
         char c;
         while(fread(&c,1,1,in)){
                 *p = c;
                 p++;
                 buf.len++;
         }
+        ip_init(); // 发送前需要路由表中的默认路由
         printf("\e[0;34mFeeding input.\n");
         ip_out(&buf,net_if_ip,NET_PROTOCOL_TCP);
 
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "ip.h"
+#include "udp.h"
+#include "checksum.h"
+#include "clock.h"
+#include "timer.h"
+#include "driver.h"
+#include "utils.h"
+#include "test.h"
+
+extern map_t ip_reass_table;
+extern size_t ip_reass_mem;
+
+#define TEST_PROTOCOL 253 //用于实验的上层协议号
+#define TEST_PORT 60000    //udp测试端口
+
+static uint8_t peer_ip[] = {192, 168, 163, 9};
+static uint8_t peer_mac[] = {0x02, 0, 0, 0, 0, 0x09};
+static uint8_t payload[UINT16_MAX];
+
+static int delivered, segs;
+static size_t delivered_len;
+static uint8_t delivered_data[4096];
+static uint8_t *first_seg;
+
+/**
+ * @brief 记录交给上层的数据报
+ */
+static void test_handler(buf_t *buf, uint8_t *src_ip)
+{
+        delivered++;
+        delivered_len = buf_chain_len(buf);
+        segs = 0;
+        for (buf_t *seg = buf; seg; seg = seg->next)
+                segs++;
+        first_seg = buf->data;
+        if (delivered_len <= sizeof(delivered_data))
+                buf_gather(buf, delivered_data, sizeof(delivered_data));
+}
+
+static size_t udp_len;
+static int udp_match;
+
+/**
+ * @brief 记录交给udp处理程序的数据，与payload中udp头之后的部分比较
+ */
+static void udp_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+        udp_len = len;
+        udp_match = !memcmp(data, payload + sizeof(udp_hdr_t), len);
+}
+
+/**
+ * @brief 生成一个分片，负载取自payload中[offset, offset + len)
+ */
+static void make_fragment(buf_t *buf, uint8_t protocol, uint16_t id, size_t offset, size_t len, int mf)
+{
+        buf_init(buf, sizeof(ip_hdr_t) + len);
+        ipv4_hdr_build((ip_hdr_t *)buf->data, peer_ip, net_if_ip, protocol, id, IP_DEFALUT_TTL, (mf ? IP_MORE_FRAGMENT : 0) | offset / IP_HDR_OFFSET_PER_BYTE, len);
+        memcpy(buf->data + sizeof(ip_hdr_t), payload + offset, len);
+}
+
+int main(int argc, char* argv[]){
+        printf("\e[0;34mTest begin.\n");
+        pcap_in = open_file(argv[1], "in.pcap","r");
+        pcap_out = tmpfile();
+        control_flow = ip_fout = icmp_fout = udp_fout = arp_log_f = tmpfile();
+        if(pcap_in == 0 || pcap_out == 0 || control_flow == 0){
+                printf("\e[1;31mFailed to open files\n\e[0m");
+                return -1;
+        }
+        net_init();
+        net_add_protocol(TEST_PROTOCOL, test_handler);
+        for(int i = 0; i < sizeof(payload); i++)
+                payload[i] = i * 13 + 7;
+
+        // 乱序、重复的分片只交付一次，交付的是共享原数据块的分片链
+        buf_t frags[4] = {0};
+        make_fragment(&frags[0], TEST_PROTOCOL, 1, 2960, 40, 0);
+        make_fragment(&frags[1], TEST_PROTOCOL, 1, 0, 1480, 1);
+        make_fragment(&frags[2], TEST_PROTOCOL, 1, 0, 1480, 1);
+        make_fragment(&frags[3], TEST_PROTOCOL, 1, 1480, 1480, 1);
+        uint8_t *head_data = frags[1].data + sizeof(ip_hdr_t);
+        for(int i = 0; i < 4; i++)
+                ip_in(&frags[i], peer_mac);
+        CHECK(delivered == 1 && delivered_len == 3000 && segs == 3 && first_seg == head_data);
+        CHECK(!memcmp(delivered_data, payload, 3000));
+        CHECK(map_size(&ip_reass_table) == 0 && ip_reass_mem == 0);
+
+        // 重叠的部分被裁掉
+        make_fragment(&frags[0], TEST_PROTOCOL, 2, 0, 16, 1);
+        make_fragment(&frags[1], TEST_PROTOCOL, 2, 8, 24, 1);
+        make_fragment(&frags[2], TEST_PROTOCOL, 2, 32, 5, 0);
+        for(int i = 0; i < 3; i++)
+                ip_in(&frags[i], peer_mac);
+        CHECK(delivered == 2 && delivered_len == 37 && !memcmp(delivered_data, payload, 37));
+
+        // 批处理中分片完成的数据报与前面的包保持顺序
+        buf_t *vec[3] = {&frags[0], &frags[1], &frags[2]};
+        uint8_t *macs[3] = {peer_mac, peer_mac, peer_mac};
+        make_fragment(&frags[0], TEST_PROTOCOL, 3, 0, 8, 1);
+        make_fragment(&frags[1], TEST_PROTOCOL, 4, 0, 100, 0);
+        make_fragment(&frags[2], TEST_PROTOCOL, 3, 8, 8, 0);
+        ip_in_burst(vec, macs, 3);
+        CHECK(delivered == 4 && delivered_len == 16 && segs == 2);
+
+        // 不完整的数据报超时后释放
+        make_fragment(&frags[0], TEST_PROTOCOL, 5, 0, 64, 1);
+        ip_in(&frags[0], peer_mac);
+        CHECK(map_size(&ip_reass_table) == 1 && ip_reass_mem > 0);
+        clock_advance((IP_REASS_TIMEOUT_SEC + 2) * 1000);
+        timer_poll();
+        CHECK(map_size(&ip_reass_table) == 0 && ip_reass_mem == 0);
+
+        // 最大的udp数据报经真实的udp_in：在分片链上校验，交给处理程序前才合并为连续数据
+        size_t total = UINT16_MAX - sizeof(ip_hdr_t), frag_len = 1480;
+        udp_hdr_t *uh = (udp_hdr_t *)payload;
+        uh->src_port16 = swap16(TEST_PORT);
+        uh->dst_port16 = swap16(TEST_PORT);
+        uh->total_len16 = swap16(total);
+        uh->checksum16 = 0;
+        udp_peso_hdr_t peso = {.protocol = NET_PROTOCOL_UDP, .total_len16 = swap16(total)};
+        memcpy(peso.src_ip, peer_ip, NET_IP_LEN);
+        memcpy(peso.dst_ip, net_if_ip, NET_IP_LEN);
+        uint16_t sum = checksum_combine(checksum_sum16(&peso, sizeof(peso)), checksum_sum16(payload, total), sizeof(peso));
+        uh->checksum16 = ~sum;
+        udp_open(TEST_PORT, udp_handler);
+        for(size_t offset = 0; offset < total; offset += frag_len){
+                size_t len = total - offset < frag_len ? total - offset : frag_len;
+                make_fragment(&frags[0], NET_PROTOCOL_UDP, 200, offset, len, offset + len < total);
+                ip_in(&frags[0], peer_mac);
+        }
+        CHECK(udp_len == total - sizeof(udp_hdr_t) && udp_match);
+        uh->checksum16 = ~sum ^ 1; // 校验和错误的数据报重组后被丢弃
+        udp_len = 0;
+        for(size_t offset = 0; offset < total; offset += frag_len){
+                size_t len = total - offset < frag_len ? total - offset : frag_len;
+                make_fragment(&frags[0], NET_PROTOCOL_UDP, 201, offset, len, offset + len < total);
+                ip_in(&frags[0], peer_mac);
+        }
+        CHECK(udp_len == 0 && map_size(&ip_reass_table) == 0 && ip_reass_mem == 0);
+
+        // 占用超过上限时从最早的数据报开始淘汰
+        size_t n = 0;
+        ip_reass_key_t key = {.protocol = TEST_PROTOCOL};
+        memcpy(key.src_ip, peer_ip, NET_IP_LEN);
+        memcpy(key.dst_ip, net_if_ip, NET_IP_LEN);
+        for(uint16_t id = 100; map_size(&ip_reass_table) == n; id++, n++){
+                make_fragment(&frags[0], TEST_PROTOCOL, id, 0, 64, 1);
+                ip_in(&frags[0], peer_mac);
+                CHECK(ip_reass_mem <= IP_REASS_MAX_BYTES);
+        }
+        key.id16 = swap16(100);
+        CHECK(map_get(&ip_reass_table, &key) == NULL);
+        key.id16 = swap16(100 + n - 1);
+        CHECK(map_get(&ip_reass_table, &key) != NULL && delivered == 4);
+
+        for(int i = 0; i < 4; i++)
+                buf_free(&frags[i]);
+        driver_close();
+        if (failed) {
+                printf("\e[1;31m====> Ip reassembly test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Ip reassembly test passed.\n\e[0m");
+        return 0;
+}
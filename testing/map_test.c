@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include "map.h"
+#include "clock.h"
+#include "test.h"
+
+static map_t map;
+
+static size_t expire_count;
+static void expire_fn(void *key, void *value, time_t *timestamp)
+{
+        expire_count++;
+}
+
+static size_t foreach_count;
+static uint32_t foreach_sum;
+static void count_fn(void *key, void *value, time_t *timestamp)
+{
+        foreach_count++;
+        foreach_sum += *(uint32_t *)value;
+}
+
+static void delete_fn(void *key, void *value, time_t *timestamp)
+{
+        foreach_count++;
+        if (*(uint32_t *)key % 4 == 1)
+                map_delete(&map, key);
+}
+
+int main(int argc, char* argv[])
+{
+        const uint32_t n = 1000000;
+        printf("\e[0;34mTest begin.\n");
+        map_init(&map, sizeof(uint32_t), sizeof(uint32_t), 0, 0, NULL, NULL);
+        CHECK(map.capacity == 0);
+
+        for (uint32_t i = 0; i < n; i++) {
+                uint32_t value = i * 3;
+                CHECK(map_set(&map, &i, &value) == 0);
+        }
+        CHECK(map_size(&map) == n);
+        for (uint32_t i = 0; i < n; i++) {
+                uint32_t *value = map_get(&map, &i);
+                CHECK(value && *value == i * 3);
+        }
+        uint32_t missing = n;
+        CHECK(map_get(&map, &missing) == NULL);
+
+        // 更新已有的键不改变大小
+        uint32_t key = 7, value = 1;
+        CHECK(map_set(&map, &key, &value) == 0);
+        CHECK(map_size(&map) == n && *(uint32_t *)map_get(&map, &key) == 1);
+
+        // 删除偶数键，剩余的键必须仍可查到
+        for (uint32_t i = 0; i < n; i += 2)
+                map_delete(&map, &i);
+        map_delete(&map, &missing);
+        CHECK(map_size(&map) == n / 2);
+        for (uint32_t i = 0; i < n; i++) {
+                uint32_t *value = map_get(&map, &i);
+                if (i % 2 == 0)
+                        CHECK(value == NULL);
+                else
+                        CHECK(value && *value == (i == 7 ? 1 : i * 3));
+        }
+
+        foreach_count = 0;
+        foreach_sum = 0;
+        map_foreach(&map, count_fn);
+        CHECK(foreach_count == n / 2);
+
+        // 遍历中删除当前键值对，其余的键值对仍然各访问一次
+        foreach_count = 0;
+        map_foreach(&map, delete_fn);
+        CHECK(foreach_count == n / 2 && map_size(&map) == n / 4);
+        for (uint32_t i = 1; i < n; i += 2)
+                CHECK((map_get(&map, &i) == NULL) == (i % 4 == 1));
+
+        // 删空后存储空间缩回最小
+        for (uint32_t i = 1; i < n; i += 2)
+                map_delete(&map, &i);
+        CHECK(map_size(&map) == 0 && map.bucket_mask + 1 == MAP_MIN_BUCKETS);
+        map_destroy(&map);
+
+        // 超时的键由时间轮主动回收，插入时若已满也会先回收超时的键
+        clock_set_virtual(1000000);
+        timer_init();
+        map_init(&map, sizeof(uint32_t), sizeof(uint32_t), 2, 5, NULL, NULL);
+        map_set_expire_handler(&map, expire_fn);
+        key = 1;
+        CHECK(map_set(&map, &key, &key) == 0);
+        clock_advance(3000);
+        key = 2;
+        CHECK(map_set(&map, &key, &key) == 0);
+        clock_advance(3000);
+        key = 3;
+        CHECK(map_set(&map, &key, &key) == 0);
+        CHECK(map_size(&map) == 2 && expire_count == 1);
+        key = 1;
+        CHECK(map_get(&map, &key) == NULL);
+        clock_advance(3500);
+        timer_poll();
+        key = 2;
+        CHECK(map_get(&map, &key) == NULL && expire_count == 2);
+        key = 3;
+        CHECK(map_get(&map, &key) != NULL);
+        clock_advance(4000);
+        timer_poll();
+        CHECK(map_size(&map) == 0 && expire_count == 3);
+
+        // 重新初始化仍在使用的map时先撤下它的定时器并释放存储空间
+        CHECK(map_set(&map, &key, &key) == 0);
+        map_init(&map, sizeof(uint32_t), sizeof(uint32_t), 2, 5, NULL, NULL);
+        CHECK(map_size(&map) == 0 && map_get(&map, &key) == NULL);
+        clock_advance(10000);
+        timer_poll();
+        CHECK(expire_count == 3);
+        map_destroy(&map);
+
+        // 容量上限
+        map_init(&map, sizeof(uint32_t), sizeof(uint32_t), 4, 0, NULL, NULL);
+        for (uint32_t i = 0; i < 4; i++)
+                CHECK(map_set(&map, &i, &i) == 0);
+        CHECK(map_set(&map, &missing, &missing) == -1);
+        key = 2;
+        map_delete(&map, &key);
+        CHECK(map_set(&map, &missing, &missing) == 0);
+
+        // 最早的键值对按插入或更新的先后排列，删除后顺延
+        CHECK(map_oldest(&map) && *(uint32_t *)map_oldest(&map) == 0);
+        key = 0;
+        CHECK(map_set(&map, &key, &key) == 0 && *(uint32_t *)map_oldest(&map) == 1);
+        key = 1;
+        map_delete(&map, &key);
+        CHECK(*(uint32_t *)map_oldest(&map) == 3);
+        map_destroy(&map);
+
+        if (failed) {
+                printf("\e[1;31m====> Map test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Map test passed.\n\e[0m");
+        return 0;
+}
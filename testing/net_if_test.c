@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "route.h"
+#include "driver.h"
+#include "utils.h"
+#include "test.h"
+
+extern map_t arp_table;
+
+#define PAYLOAD_LEN 26 //测试帧的ip负载长度
+
+static uint8_t if1_ip[] = {10, 9, 0, 1};
+static uint8_t if1_mac[] = {0x02, 0, 0, 0, 0x09, 0x01};
+static uint8_t peer_ip[] = {10, 9, 0, 7};
+static uint8_t peer_mac[] = {0x02, 0, 0, 0, 0x09, 0x07};
+static uint8_t remote_ip[] = {192, 168, 163, 9};
+
+int main(int argc, char* argv[]){
+        printf("\e[0;34mTest begin.\n");
+        pcap_in = open_file(argv[1], "in.pcap","r");
+        pcap_out = tmpfile();
+        control_flow = ip_fout = icmp_fout = udp_fout = arp_log_f = tmpfile();
+        if(pcap_in == 0 || pcap_out == 0 || control_flow == 0){
+                printf("\e[1;31mFailed to open files\n\e[0m");
+                return -1;
+        }
+        CHECK(net_if_add(if1_ip, if1_mac, 24) == 1);
+        net_init();
+        CHECK(net_if_count == 2 && net_if_find(if1_ip) == &net_ifs[1] && net_if_find(peer_ip) == NULL);
+
+        // 每个网卡的子网是经由该网卡的直连路由，源地址取出口网卡的地址
+        CHECK(route_lookup(peer_ip) && route_lookup(peer_ip)->if_index == 1);
+        CHECK(route_lookup(remote_ip) && route_lookup(remote_ip)->if_index == 0);
+        CHECK(ip_source(peer_ip) == net_ifs[1].ip && ip_source(remote_ip) == net_ifs[0].ip);
+        CHECK(net_ifs[0].stats.tx_packets == 1 && net_ifs[1].stats.tx_packets == 1); // 各自的免费arp
+
+        // 只应答询问收到请求的网卡地址的arp请求，邻居记录所在的网卡
+        buf_t *pkt = arp_pkt_build(ARP_REQUEST, peer_ip, peer_mac, net_if_ip);
+        pkt->if_index = 1;
+        arp_in(pkt, peer_mac);
+        CHECK(net_ifs[1].stats.tx_packets == 1);
+        pkt = arp_pkt_build(ARP_REQUEST, peer_ip, peer_mac, if1_ip);
+        pkt->if_index = 1;
+        arp_in(pkt, peer_mac);
+        CHECK(net_ifs[1].stats.tx_packets == 2 && net_ifs[0].stats.tx_packets == 1);
+        arp_entry_t *entry = map_get(&arp_table, peer_ip);
+        CHECK(entry && entry->if_index == 1 && !memcmp(entry->mac, peer_mac, NET_MAC_LEN));
+
+        // 本机发出的包从路由给出的网卡发出，源地址与源mac都是该网卡的
+        buf_t buf = {0};
+        buf_init(&buf, PAYLOAD_LEN);
+        ip_out(&buf, peer_ip, NET_PROTOCOL_UDP);
+        ether_hdr_t *eth = (ether_hdr_t *)buf.data;
+        ip_hdr_t *iph = (ip_hdr_t *)(eth + 1);
+        CHECK(buf.if_index == 1 && net_ifs[1].stats.tx_packets == 3);
+        CHECK(!memcmp(eth->src, if1_mac, NET_MAC_LEN) && !memcmp(eth->dst, peer_mac, NET_MAC_LEN));
+        CHECK(!memcmp(iph->src_ip, if1_ip, NET_IP_LEN));
+
+        // 在网卡之间转发
+        ip_forwarding = 1;
+        ipv4_frame_build(&buf, 0, remote_ip, peer_ip, 64, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        eth = (ether_hdr_t *)buf.data;
+        CHECK(ip_stats.forwarded == 1 && buf.if_index == 1 && net_ifs[1].stats.tx_packets == 4);
+        CHECK(!memcmp(eth->src, if1_mac, NET_MAC_LEN) && !memcmp(eth->dst, peer_mac, NET_MAC_LEN));
+
+        // 强主机模型：从网卡1收到发往网卡0地址的包既不交给本机也不转发
+        ipv4_frame_build(&buf, 1, peer_ip, net_if_ip, 64, 0, PAYLOAD_LEN);
+        ethernet_in(&buf);
+        CHECK(ip_stats.forwarded == 1 && ip_stats.no_route == 0);
+        CHECK(net_ifs[0].stats.tx_packets == 1 && net_ifs[1].stats.tx_packets == 4);
+
+        buf_free(&buf);
+        driver_close();
+        if (failed) {
+                printf("\e[1;31m====> Net if test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Net if test passed.\n\e[0m");
+        return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "route.h"
+#include "driver.h"
+#include "clock.h"
+#include "timer.h"
+#include "utils.h"
+#include "test.h"
+
+#define PCAP_RECORD_HDR_LEN 16 //pcap文件中每个包前的记录头长度
+
+static uint8_t router_ip[] = {192, 168, 163, 1};
+static uint8_t remote_ip[] = {10, 1, 2, 3};
+static uint8_t remote_mac[] = {0x02, 0, 0, 0, 0, 0x03};
+static uint8_t other_ip[] = {10, 1, 2, 4};
+static uint8_t other_mac[] = {0x02, 0, 0, 0, 0, 0x04};
+static uint8_t peer_ip[] = {192, 168, 163, 9};
+static uint8_t peer_mac[] = {0x02, 0, 0, 0, 0, 0x09};
+
+/**
+ * @brief 模拟路由器发来的icmp需要分片，引用本机发往dst、长度为len的数据报首部
+ */
+static void frag_needed(uint8_t *dst, uint16_t len, int df, uint16_t mtu)
+{
+        buf_t buf = {0};
+        buf_init(&buf, sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8);
+        memset(buf.data, 0, buf.len);
+        icmp_hdr_t *ich = (icmp_hdr_t *)buf.data;
+        ich->type = ICMP_TYPE_UNREACH;
+        ich->code = ICMP_CODE_FRAG_NEEDED;
+        ich->seq16 = swap16(mtu);
+        ipv4_hdr_build((ip_hdr_t *)(ich + 1), net_if_ip, dst, NET_PROTOCOL_TCP, 0, IP_DEFALUT_TTL, df ? IP_DONT_FRAGMENT : 0, len - sizeof(ip_hdr_t));
+        ich->checksum16 = checksum16((uint16_t *)buf.data, buf.len);
+        icmp_in(&buf, router_ip);
+        buf_free(&buf);
+}
+
+/**
+ * @brief 发出一个负载长度为len的TCP数据包，返回其ip头中的标志与偏移
+ */
+static uint16_t send_tcp(uint8_t *dst, size_t len)
+{
+        buf_t buf = {0};
+        buf_init(&buf, len);
+        memset(buf.data, 0, len);
+        ip_out(&buf, dst, NET_PROTOCOL_TCP);
+        uint16_t flags = swap16(((ip_hdr_t *)(buf.data + sizeof(ether_hdr_t)))->flags_fragment16);
+        buf_free(&buf);
+        return flags;
+}
+
+int main(int argc, char* argv[]){
+        printf("\e[0;34mTest begin.\n");
+        pcap_in = open_file(argv[1], "in.pcap","r");
+        pcap_out = tmpfile();
+        control_flow = ip_fout = icmp_fout = udp_fout = arp_log_f = tmpfile();
+        if(pcap_in == 0 || pcap_out == 0 || control_flow == 0){
+                printf("\e[1;31mFailed to open files\n\e[0m");
+                return -1;
+        }
+        net_init();
+        arp_in(arp_pkt_build(ARP_REPLY, remote_ip, remote_mac, net_if_ip), remote_mac);
+        arp_in(arp_pkt_build(ARP_REPLY, other_ip, other_mac, net_if_ip), other_mac);
+        arp_in(arp_pkt_build(ARP_REPLY, peer_ip, peer_mac, net_if_ip), peer_mac);
+        CHECK(ip_path_mtu(remote_ip) == ETHERNET_MAX_TRANSPORT_UNIT);
+
+        // TCP报文段设置DF，其他协议不设置
+        CHECK(send_tcp(remote_ip, 100) == IP_DONT_FRAGMENT);
+        buf_t buf = {0};
+        buf_init(&buf, 100);
+        ip_out(&buf, remote_ip, NET_PROTOCOL_UDP);
+        CHECK(((ip_hdr_t *)(buf.data + sizeof(ether_hdr_t)))->flags_fragment16 == 0);
+
+        // 需要分片降低路径MTU，只降不升；不是本机设置了DF发出的数据报引发的忽略
+        frag_needed(remote_ip, 1500, 1, 1280);
+        CHECK(ip_path_mtu(remote_ip) == 1280 && ip_stats.pmtu_updates == 1);
+        frag_needed(remote_ip, 1500, 1, 1400);
+        CHECK(ip_path_mtu(remote_ip) == 1280 && ip_stats.pmtu_updates == 1);
+        frag_needed(other_ip, 1500, 0, 1000);
+        CHECK(ip_path_mtu(other_ip) == ETHERNET_MAX_TRANSPORT_UNIT);
+        CHECK(ip_path_mtu(peer_ip) == ETHERNET_MAX_TRANSPORT_UNIT);
+
+        // 按路径MTU分片，不需分片的TCP报文段仍然设置DF
+        uint64_t sent = net_ifs[0].stats.tx_packets;
+        buf_init(&buf, 1400);
+        memset(buf.data, 0, buf.len);
+        ip_out(&buf, remote_ip, NET_PROTOCOL_UDP);
+        CHECK(net_ifs[0].stats.tx_packets == sent + 2);
+        CHECK(send_tcp(remote_ip, 1280 - sizeof(ip_hdr_t)) == IP_DONT_FRAGMENT);
+
+        // 没有给出下一跳MTU时取比原数据报短的常见MTU；低于下限的按下限记录且不再设置DF
+        frag_needed(remote_ip, 1280, 1, 0);
+        CHECK(ip_path_mtu(remote_ip) == 1006);
+        frag_needed(remote_ip, 1006, 1, 300);
+        CHECK(ip_path_mtu(remote_ip) == IP_PMTU_MIN);
+        CHECK(send_tcp(remote_ip, 100) == 0);
+
+        // 老化后恢复为网卡的MTU
+        clock_advance((IP_PMTU_TIMEOUT_SEC + 2) * 1000);
+        timer_poll();
+        CHECK(ip_path_mtu(remote_ip) == ETHERNET_MAX_TRANSPORT_UNIT);
+
+        // 转发时设置了DF的超长数据包回复需要分片，带上出口网卡的MTU
+        arp_in(arp_pkt_build(ARP_REPLY, peer_ip, peer_mac, net_if_ip), peer_mac); // arp表项已在推进时钟时过期
+        ip_forwarding = 1;
+        net_ifs[0].mtu = 1000;
+        ipv4_frame_build(&buf, 0, peer_ip, remote_ip, IP_DEFALUT_TTL, IP_DONT_FRAGMENT, 1200 - sizeof(ip_hdr_t));
+        ethernet_in(&buf);
+        CHECK(ip_stats.too_big == 1 && ip_stats.forwarded == 0);
+        ip_hdr_t *reply = (ip_hdr_t *)(txbuf.data + sizeof(ether_hdr_t));
+        icmp_hdr_t *ich = (icmp_hdr_t *)(reply + 1);
+        CHECK(!memcmp(reply->dst_ip, peer_ip, NET_IP_LEN));
+        CHECK(ich->type == ICMP_TYPE_UNREACH && ich->code == ICMP_CODE_FRAG_NEEDED && swap16(ich->seq16) == 1000);
+        CHECK(!memcmp(((ip_hdr_t *)(ich + 1))->dst_ip, remote_ip, NET_IP_LEN));
+
+        // 没有设置DF的超长数据包分片转发，分片保留原数据报的id、源地址与减一后的TTL
+        arp_in(arp_pkt_build(ARP_REPLY, remote_ip, remote_mac, net_if_ip), remote_mac);
+        size_t first_len = sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 976, last_len = sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 204;
+        uint8_t frames[first_len + PCAP_RECORD_HDR_LEN + last_len];
+        ip_hdr_t *first = (ip_hdr_t *)(frames + sizeof(ether_hdr_t));
+        ip_hdr_t *last = (ip_hdr_t *)(frames + sizeof(frames) - last_len + sizeof(ether_hdr_t));
+        for(uint16_t offset = 0; offset <= 100; offset += 100){
+                sent = net_ifs[0].stats.tx_packets;
+                ipv4_frame_build(&buf, 0, peer_ip, remote_ip, IP_DEFALUT_TTL, 0, 1200 - sizeof(ip_hdr_t));
+                uint16_t flags = offset ? IP_MORE_FRAGMENT | offset : 0; // 第二轮转发的本身是中间的分片
+                ipv4_hdr_build((ip_hdr_t *)(buf.data + sizeof(ether_hdr_t)), peer_ip, remote_ip, NET_PROTOCOL_UDP, 0x1234, IP_DEFALUT_TTL, flags, 1200 - sizeof(ip_hdr_t));
+                ethernet_in(&buf);
+                CHECK(net_ifs[0].stats.tx_packets == sent + 2 && ip_stats.too_big == 1);
+                fflush(pcap_out);
+                fseek(pcap_out, -(long)sizeof(frames), SEEK_END);
+                CHECK(fread(frames, 1, sizeof(frames), pcap_out) == sizeof(frames));
+                fseek(pcap_out, 0, SEEK_END);
+                CHECK(swap16(first->total_len16) == sizeof(ip_hdr_t) + 976 && swap16(last->total_len16) == sizeof(ip_hdr_t) + 204);
+                CHECK(swap16(first->flags_fragment16) == (IP_MORE_FRAGMENT | offset));
+                CHECK(swap16(last->flags_fragment16) == ((flags & IP_MORE_FRAGMENT) | (offset + 976 / IP_HDR_OFFSET_PER_BYTE)));
+                CHECK(first->id16 == swap16(0x1234) && last->id16 == swap16(0x1234));
+                CHECK(first->ttl == IP_DEFALUT_TTL - 1 && last->ttl == IP_DEFALUT_TTL - 1);
+                CHECK(!memcmp(first->src_ip, peer_ip, NET_IP_LEN) && !memcmp(last->src_ip, peer_ip, NET_IP_LEN));
+                CHECK(checksum16((uint16_t *)first, sizeof(ip_hdr_t)) == 0 && checksum16((uint16_t *)last, sizeof(ip_hdr_t)) == 0);
+        }
+        CHECK(ip_stats.fragmented == 2 && ip_stats.forwarded == 2);
+        net_ifs[0].mtu = ETHERNET_MAX_TRANSPORT_UNIT;
+
+        buf_free(&buf);
+        driver_close();
+        if (failed) {
+                printf("\e[1;31m====> Pmtu test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Pmtu test passed.\n\e[0m");
+        return 0;
+}
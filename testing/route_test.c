@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "route.h"
+#include "test.h"
+
+uint32_t arp_generation = 1;
+
+#define RULES 4000   //随机测试中的路由条数
+#define PROBES 20000  //随机测试中查找的地址数
+
+typedef struct rule //参考实现中的一条路由
+{
+        uint32_t prefix;
+        uint8_t len;
+        uint8_t gw;
+        int live;
+} rule_t;
+
+static rule_t rules[RULES];
+
+static void to_ip(uint32_t addr, uint8_t *ip)
+{
+        ip[0] = addr >> 24, ip[1] = addr >> 16, ip[2] = addr >> 8, ip[3] = addr;
+}
+
+static uint32_t mask_of(uint8_t len)
+{
+        return len ? UINT32_MAX << (32 - len) : 0;
+}
+
+/**
+ * @brief 添加路由，网关取10.0.0.gw
+ */
+static int add(uint32_t prefix, uint8_t len, uint8_t gw)
+{
+        uint8_t ip[NET_IP_LEN], gateway[NET_IP_LEN] = {10, 0, 0, gw};
+        to_ip(prefix, ip);
+        return route_add(ip, len, gw ? gateway : NULL, 0);
+}
+
+static int del(uint32_t prefix, uint8_t len)
+{
+        uint8_t ip[NET_IP_LEN];
+        to_ip(prefix, ip);
+        return route_delete(ip, len);
+}
+
+/**
+ * @brief 查找地址，返回网关的最后一字节，直连为0，没有路由为-1
+ */
+static int lookup(uint32_t addr)
+{
+        uint8_t ip[NET_IP_LEN];
+        to_ip(addr, ip);
+        route_nh_t *nh = route_lookup(ip);
+        return nh ? nh->gateway[3] : -1;
+}
+
+/**
+ * @brief 逐条比较的参考实现
+ */
+static int reference(uint32_t addr)
+{
+        int best = -1, len = -1;
+        for(int i = 0; i < RULES; i++)
+                if(rules[i].live && rules[i].len > len && ((addr ^ rules[i].prefix) & mask_of(rules[i].len)) == 0)
+                        best = rules[i].gw, len = rules[i].len;
+        return best;
+}
+
+static uint32_t ip4(int a, int b, int c, int d)
+{
+        return (uint32_t)a << 24 | b << 16 | c << 8 | d;
+}
+
+int main(int argc, char* argv[]){
+        printf("\e[0;34mTest begin.\n");
+        route_init();
+        CHECK(lookup(ip4(1, 2, 3, 4)) == -1);
+
+        // 重叠的前缀按最长匹配，长于/24的前缀与较短前缀的添加顺序无关
+        CHECK(add(ip4(192, 168, 1, 128), 25, 25) == 0);
+        CHECK(add(ip4(192, 168, 1, 7), 32, 32) == 0);
+        CHECK(add(ip4(192, 168, 0, 0), 16, 16) == 0);
+        CHECK(add(ip4(192, 168, 1, 0), 24, 24) == 0);
+        CHECK(add(0, 0, 1) == 0);
+        CHECK(route_size() == 5);
+        CHECK(lookup(ip4(8, 8, 8, 8)) == 1);
+        CHECK(lookup(ip4(192, 168, 2, 1)) == 16);
+        CHECK(lookup(ip4(192, 168, 1, 1)) == 24);
+        CHECK(lookup(ip4(192, 168, 1, 7)) == 32);
+        CHECK(lookup(ip4(192, 168, 1, 200)) == 25);
+
+        // 相同前缀再次添加时替换下一跳，路由变化使缓存的下一跳失效
+        uint32_t gen = arp_generation;
+        CHECK(add(ip4(192, 168, 1, 128), 25, 26) == 0);
+        CHECK(route_size() == 5 && arp_generation != gen);
+        CHECK(lookup(ip4(192, 168, 1, 200)) == 26 && lookup(ip4(192, 168, 1, 1)) == 24);
+
+        // 删除后由次长的匹配前缀接管
+        CHECK(del(ip4(192, 168, 1, 0), 24) == 0);
+        CHECK(lookup(ip4(192, 168, 1, 1)) == 16 && lookup(ip4(192, 168, 1, 200)) == 26);
+        CHECK(del(ip4(192, 168, 1, 128), 25) == 0 && del(ip4(192, 168, 1, 7), 32) == 0);
+        CHECK(lookup(ip4(192, 168, 1, 200)) == 16 && lookup(ip4(192, 168, 1, 7)) == 16);
+        CHECK(del(ip4(192, 168, 1, 7), 32) == -1);
+        CHECK(del(0, 0) == 0 && lookup(ip4(8, 8, 8, 8)) == -1);
+
+        // 直连路由的下一跳是目的地址本身
+        uint8_t dst[NET_IP_LEN] = {192, 168, 9, 9};
+        CHECK(add(ip4(192, 168, 9, 0), 24, 0) == 0);
+        CHECK(route_next_hop(dst) == dst);
+        dst[2] = 8;
+        CHECK(route_next_hop(dst) && route_next_hop(dst)[3] == 16);
+        CHECK(del(ip4(192, 168, 9, 0), 24) == 0 && del(ip4(192, 168, 0, 0), 16) == 0);
+        CHECK(route_size() == 0);
+
+        // 不长于/8的前缀在短前缀表中，只在没有更长的前缀匹配时生效
+        CHECK(add(ip4(10, 0, 0, 0), 8, 8) == 0 && add(0, 1, 1) == 0);
+        CHECK(lookup(ip4(10, 1, 1, 1)) == 8 && lookup(ip4(11, 1, 1, 1)) == 1 && lookup(ip4(200, 1, 1, 1)) == -1);
+        CHECK(add(ip4(10, 1, 0, 0), 16, 16) == 0 && lookup(ip4(10, 1, 1, 1)) == 16);
+        CHECK(del(ip4(10, 1, 0, 0), 16) == 0 && lookup(ip4(10, 1, 1, 1)) == 8);
+        CHECK(del(ip4(10, 0, 0, 0), 8) == 0 && lookup(ip4(10, 1, 1, 1)) == 1);
+        CHECK(del(0, 1) == 0 && route_size() == 0 && lookup(ip4(10, 1, 1, 1)) == -1);
+
+        // 随机添加和删除，与逐条比较的结果一致；前缀集中在10.0.0.0/14中以制造大量重叠
+        srand(1);
+        for(int i = 0; i < RULES; i++){
+                rules[i].len = i % 8 == 0 ? rand() % 16 : 16 + rand() % 17;
+                rules[i].prefix = (ip4(10, 0, 0, 0) | rand() % (1 << 18)) & mask_of(rules[i].len);
+                rules[i].gw = 1 + rand() % 200;
+                for(int j = 0; j < i; j++)
+                        if(rules[j].live && rules[j].prefix == rules[i].prefix && rules[j].len == rules[i].len)
+                                rules[j].live = 0;
+                rules[i].live = 1;
+                CHECK(add(rules[i].prefix, rules[i].len, rules[i].gw) == 0);
+        }
+        for(int i = 0; i < RULES; i += 3)
+                if(rules[i].live){
+                        CHECK(del(rules[i].prefix, rules[i].len) == 0);
+                        rules[i].live = 0;
+                }
+        int mismatch = 0;
+        for(int i = 0; i < PROBES; i++){
+                uint32_t addr = i % 2 ? rules[rand() % RULES].prefix + rand() % 256 : ip4(10, 0, 0, 0) | rand() % (1 << 18);
+                mismatch += lookup(addr) != reference(addr);
+        }
+        CHECK(mismatch == 0);
+
+        if (failed) {
+                printf("\e[1;31m====> Route test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Route test passed.\n\e[0m");
+        return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include "ip.h"
+
+// 由global.c提供的测试输入输出文件
+extern FILE *pcap_in;
+extern FILE *pcap_out;
+extern FILE *ip_fout;
+extern FILE *icmp_fout;
+extern FILE *udp_fout;
+extern FILE *control_flow;
+extern FILE *arp_log_f;
+
+FILE* open_file(char * path, char * name, char * mode);
+
+// 由global.c提供的测试报文生成函数
+buf_t* arp_pkt_build(uint16_t opcode, uint8_t *sender_ip, uint8_t *sender_mac, uint8_t *target_ip);
+void ipv4_hdr_build(ip_hdr_t *iph, uint8_t *src, uint8_t *dst, uint8_t protocol, uint16_t id, uint8_t ttl, uint16_t flags, size_t payload_len);
+void ipv4_frame_build(buf_t *buf, uint8_t if_index, uint8_t *src, uint8_t *dst, uint8_t ttl, uint16_t flags, size_t payload_len);
+
+static int failed; //有检查失败时置1，每个测试程序各有一份
+
+// 检查条件，失败时打印所在行并记录，测试继续执行
+#define CHECK(cond)                                                              \
+        do {                                                                     \
+                if (!(cond)) {                                                   \
+                        printf("\e[0;31mCheck failed at line %d: %s\n", __LINE__, #cond); \
+                        failed = 1;                                              \
+                }                                                                \
+        } while (0)
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "clock.h"
+#include "timer.h"
+
+#define TIMER_NUM 2000
+
+static net_timer_t timers[TIMER_NUM];
+static uint64_t deadline[TIMER_NUM];
+static int fired[TIMER_NUM];
+static int failed;
+static uint64_t last_poll;
+
+static void on_fire(void *arg)
+{
+        size_t i = (net_timer_t *)arg - timers;
+        fired[i]++;
+        // 到期不能早于设定时间，也不能拖到到期后的下一次轮询
+        uint64_t tick = (deadline[i] + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+        if (clock_now_ms() < deadline[i] || last_poll / TIMER_TICK_MS >= tick) {
+                printf("\e[0;31mTimer %zu fired at %llu, expected %llu\n", i,
+                       (unsigned long long)clock_now_ms(), (unsigned long long)deadline[i]);
+                failed = 1;
+        }
+}
+
+int main(int argc, char* argv[])
+{
+        printf("\e[0;34mTest begin.\n");
+        clock_set_virtual(123456789);
+        timer_init();
+        srand(1);
+        for (int i = 0; i < TIMER_NUM; i++) {
+                // 覆盖时间轮的所有层，包括超出最高层范围的定时器
+                uint64_t delay = (uint64_t)rand() % (1ull << (6 + i % 30));
+                timer_setup(&timers[i], on_fire, &timers[i]);
+                timer_arm(&timers[i], delay);
+                deadline[i] = clock_now_ms() + delay;
+        }
+        for (int i = 0; i < TIMER_NUM; i += 7)
+                timer_cancel(&timers[i]);
+
+        // 空闲等待的时长不能超过最早的定时器所在的刻度
+        uint64_t earliest = UINT64_MAX;
+        for (int i = 0; i < TIMER_NUM; i++)
+                if (i % 7 && deadline[i] < earliest)
+                        earliest = deadline[i];
+        earliest = (earliest + TIMER_TICK_MS - 1) / TIMER_TICK_MS * TIMER_TICK_MS;
+        if (timer_next_expire() > earliest) {
+                printf("\e[0;31mNext expire %llu is later than %llu\n",
+                       (unsigned long long)timer_next_expire(), (unsigned long long)earliest);
+                failed = 1;
+        }
+
+        uint64_t end = clock_now_ms() + (1ull << 36);
+        while (clock_now_ms() < end) {
+                // 步长不固定，模拟轮询间隔抖动
+                clock_advance(1 + rand() % (5 * TIMER_TICK_MS));
+                if (clock_now_ms() > 123456789 + (1ull << 22))
+                        clock_advance(rand() % 1000000);
+                timer_poll();
+                last_poll = clock_now_ms();
+        }
+
+        for (int i = 0; i < TIMER_NUM; i++) {
+                if (fired[i] != (i % 7 != 0)) {
+                        printf("\e[0;31mTimer %d fired %d times\n", i, fired[i]);
+                        failed = 1;
+                }
+        }
+        if (timer_next_expire() != UINT64_MAX) {
+                printf("\e[0;31mTimer wheel not empty\n");
+                failed = 1;
+        }
+        if (failed) {
+                printf("\e[1;31m====> Timer test failed.\n\e[0m");
+                return -1;
+        }
+        printf("\e[1;32m====> Timer test passed.\n\e[0m");
+        return 0;
+}